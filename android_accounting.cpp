@@ -0,0 +1,283 @@
+#include "android_scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/sysinfo.h>
+
+/*
+ * Per-cgroup accounting
+ *
+ * Each tier cgroup already aggregates its members: cpu.stat, memory.current,
+ * memory.stat, memory.events, memory.swap.current and memory.pressure cost
+ * six reads per tier, however many processes it contains. The monitor uses
+ * these tier figures as its primary data source, and samples individual
+ * cached and background processes only when their tier shows activity or
+ * they are promotion or kill candidates (see should_sample_process() in
+ * android_module.cpp).
+ *
+ * Memory pressure is judged from the same sources: a tier's memory.events
+ * (memory.high or memory.max hit) or the system's memory PSI, with
+ * MemAvailable as a floor (see check_memory_pressure()). read_cgroup_stats()
+ * works on any cgroup directory, so an app's own cgroup sizes its pressure
+ * memory.max and its footprint when it is picked for a kill.
+ *
+ * The same figures size memory protection for the foreground and visible
+ * tiers. The working set is taken as anon plus active_file. memory.low is
+ * set to MEMPROT_LOW_PCT of the working set, and the foreground tier also
+ * gets memory.min at MEMPROT_MIN_PCT. Under reclaim the kernel then takes
+ * background pages before foreground ones. Protection only applies down the
+ * hierarchy as far as each level grants it, so both the tier and each app
+ * cgroup in it are sized this way. A value is rewritten only when it moves
+ * by more than MEMPROT_UPDATE_PCT.
+ */
+
+typedef struct {
+    CgroupStats current;
+    CgroupStats previous;
+    double sampled_at_ms;
+    double previous_at_ms;
+    float cpu_percent;           // Share of all CPUs over the last interval
+} TierAccount;
+
+static TierAccount tiers[PROCESS_STATE_COUNT];
+static long long tier_low[PROCESS_STATE_COUNT];    // memory.low last written per tier
+static long long tier_min[PROCESS_STATE_COUNT];    // memory.min last written per tier
+
+static double monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Reads a small cgroup file in one syscall; returns bytes read or -1
+static ssize_t read_cgroup_text(const char *cgroup_path, const char *file, char *buf, size_t size) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", cgroup_path, file);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return -1;
+    ssize_t len = read(fd, buf, size - 1);
+    close(fd);
+    if (len < 0) return -1;
+    buf[len] = '\0';
+    return len;
+}
+
+// Finds "key value" in a flat-keyed cgroup file
+static unsigned long long flat_key_value(const char *text, const char *key) {
+    size_t key_len = strlen(key);
+    const char *line = text;
+    while (line && *line) {
+        if (strncmp(line, key, key_len) == 0 && line[key_len] == ' ') {
+            return strtoull(line + key_len + 1, NULL, 10);
+        }
+        line = strchr(line, '\n');
+        if (line) line++;
+    }
+    return 0;
+}
+
+int read_cgroup_stats(const char *cgroup_path, CgroupStats *stats) {
+    char buf[4096];
+    memset(stats, 0, sizeof(*stats));
+
+    if (read_cgroup_text(cgroup_path, "cpu.stat", buf, sizeof(buf)) > 0) {
+        stats->cpu_usage_usec = flat_key_value(buf, "usage_usec");
+        stats->valid = true;
+    }
+    if (read_cgroup_text(cgroup_path, "memory.current", buf, sizeof(buf)) > 0) {
+        stats->memory_current = strtoll(buf, NULL, 10);
+        stats->valid = true;
+    }
+    if (read_cgroup_text(cgroup_path, "memory.stat", buf, sizeof(buf)) > 0) {
+        stats->memory_anon = flat_key_value(buf, "anon");
+        stats->memory_file = flat_key_value(buf, "file");
+        stats->memory_active_file = flat_key_value(buf, "active_file");
+        stats->memory_zswap = flat_key_value(buf, "zswap");
+        stats->swapins = flat_key_value(buf, "pswpin") + flat_key_value(buf, "zswpin");
+    }
+    if (read_cgroup_text(cgroup_path, "memory.events", buf, sizeof(buf)) > 0) {
+        stats->events_high = flat_key_value(buf, "high");
+        stats->events_max = flat_key_value(buf, "max");
+        stats->events_oom_kill = flat_key_value(buf, "oom_kill");
+    }
+    if (read_cgroup_text(cgroup_path, "memory.swap.current", buf, sizeof(buf)) > 0) {
+        stats->swap_current = strtoll(buf, NULL, 10);
+    }
+    if (read_cgroup_text(cgroup_path, "memory.pressure", buf, sizeof(buf)) > 0) {
+        const char *total = strstr(buf, "total=");
+        if (strncmp(buf, "some ", 5) == 0 && total) stats->memory_stall_usec = strtoull(total + 6, NULL, 10);
+    }
+    return stats->valid ? 0 : -1;
+}
+
+void update_tier_accounting(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) cpus = 1;
+
+    for (int state = 0; state < PROCESS_STATE_COUNT; state++) {
+        TierAccount *tier = &tiers[state];
+        tier->previous = tier->current;
+        tier->previous_at_ms = tier->sampled_at_ms;
+
+        read_cgroup_stats(get_cgroup_for_state((ProcessState)state), &tier->current);
+        tier->sampled_at_ms = monotonic_ms();
+
+        tier->cpu_percent = 0;
+        double window_ms = tier->sampled_at_ms - tier->previous_at_ms;
+        if (tier->previous.valid && tier->current.valid && window_ms > 0 &&
+            tier->current.cpu_usage_usec >= tier->previous.cpu_usage_usec) {
+            double used_ms = (tier->current.cpu_usage_usec - tier->previous.cpu_usage_usec) / 1000.0;
+            tier->cpu_percent = (float)(100.0 * used_ms / (window_ms * cpus));
+        }
+    }
+}
+
+static long long working_set(const CgroupStats *stats) {
+    return (long long)(stats->memory_anon + stats->memory_active_file);
+}
+
+static bool protection_changed(long long current, long long target) {
+    if (current == target) return false;
+    if (current == 0 || target == 0) return true;
+    long long delta = target > current ? target - current : current - target;
+    return delta * 100 > current * MEMPROT_UPDATE_PCT;
+}
+
+static int write_protection(const char *cgroup_path, const char *file, long long bytes) {
+    char value[32];
+    snprintf(value, sizeof(value), "%lld", bytes);
+    return write_cgroup_file(cgroup_path, file, value);
+}
+
+void update_tier_protection(void) {
+    if (!cgroup_capable(CGROUP_CAP_MEMORY)) return;
+
+    struct sysinfo info;
+    long long ram_cap = 0;
+    if (sysinfo(&info) == 0) {
+        ram_cap = (long long)info.totalram * info.mem_unit / 100 * MEMPROT_MAX_RAM_PCT;
+    }
+
+    for (int state = PROCESS_STATE_FOREGROUND; state <= PROCESS_STATE_VISIBLE; state++) {
+        const CgroupStats *stats = &tiers[state].current;
+        if (!stats->valid) continue;
+
+        long long ws = working_set(stats);
+        long long low = ws * MEMPROT_LOW_PCT / 100;
+        long long min = (state == PROCESS_STATE_FOREGROUND) ? ws * MEMPROT_MIN_PCT / 100 : 0;
+        if (ram_cap > 0 && low > ram_cap) low = ram_cap;
+        if (ram_cap > 0 && min > ram_cap) min = ram_cap;
+
+        const char *cgroup = get_cgroup_for_state((ProcessState)state);
+        if (protection_changed(tier_low[state], low) &&
+            write_protection(cgroup, "memory.low", low) == 0) {
+            tier_low[state] = low;
+        }
+        if (protection_changed(tier_min[state], min) &&
+            write_protection(cgroup, "memory.min", min) == 0) {
+            tier_min[state] = min;
+        }
+    }
+}
+
+// An app's cgroup is created afresh in each tier, so apps outside the
+// protected tiers never carry protection and need no write
+void update_app_protection(TrackedProcess *leader) {
+    if (!cgroup_capable(CGROUP_CAP_MEMORY) || leader->state > PROCESS_STATE_VISIBLE) return;
+
+    char buf[4096];
+    if (read_cgroup_text(leader->cgroup_path, "memory.stat", buf, sizeof(buf)) <= 0) return;
+    CgroupStats stats;
+    memset(&stats, 0, sizeof(stats));
+    stats.memory_anon = flat_key_value(buf, "anon");
+    stats.memory_active_file = flat_key_value(buf, "active_file");
+
+    long long ws = working_set(&stats);
+    long long low = ws * MEMPROT_LOW_PCT / 100;
+    if (!protection_changed(leader->memory_low, low)) return;
+
+    if (write_protection(leader->cgroup_path, "memory.low", low) == 0) {
+        if (leader->state == PROCESS_STATE_FOREGROUND) {
+            write_protection(leader->cgroup_path, "memory.min", ws * MEMPROT_MIN_PCT / 100);
+        }
+        leader->memory_low = low;
+    }
+}
+
+const CgroupStats *get_tier_stats(ProcessState state) {
+    return &tiers[state].current;
+}
+
+float get_tier_cpu_percent(ProcessState state) {
+    return tiers[state].cpu_percent;
+}
+
+static ssize_t read_proc_text(const char *path, char *buf, size_t size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return -1;
+    ssize_t len = read(fd, buf, size - 1);
+    close(fd);
+    if (len < 0) return -1;
+    buf[len] = '\0';
+    return len;
+}
+
+// System-wide memory PSI "some" avg10, % of time; 0 without PSI
+double system_memory_stall_pct(void) {
+    char buf[256];
+    if (read_proc_text("/proc/pressure/memory", buf, sizeof(buf)) <= 0) return 0;
+    const char *avg10 = strstr(buf, "avg10=");
+    return (strncmp(buf, "some ", 5) == 0 && avg10) ? atof(avg10 + 6) : 0;
+}
+
+// MemAvailable as % of MemTotal, -1 if unknown
+int system_memory_available_pct(void) {
+    char buf[2048];
+    if (read_proc_text("/proc/meminfo", buf, sizeof(buf)) <= 0) return -1;
+    const char *total = strstr(buf, "MemTotal:");
+    const char *available = strstr(buf, "MemAvailable:");
+    if (!total || !available) return -1;
+    long long total_kb = strtoll(total + 9, NULL, 10);
+    long long available_kb = strtoll(available + 13, NULL, 10);
+    return total_kb > 0 ? (int)(available_kb * 100 / total_kb) : -1;
+}
+
+// Memory and swap charged to the app's own cgroup in bytes, -1 if it has none
+long long app_memory_footprint(const TrackedProcess *leader) {
+    CgroupStats stats;
+    if (!is_app_cgroup(leader->cgroup_path) || read_cgroup_stats(leader->cgroup_path, &stats) != 0 ||
+        stats.memory_current <= 0) {
+        return -1;
+    }
+    return stats.memory_current + stats.swap_current;
+}
+
+// True when the tier hit its memory.high or memory.max since the last cycle
+bool tier_under_memory_pressure(ProcessState state) {
+    const TierAccount *tier = &tiers[state];
+    if (!tier->previous.valid) return false;
+    return tier->current.events_high > tier->previous.events_high ||
+           tier->current.events_max > tier->previous.events_max;
+}
+
+void tier_accounting_report(void) {
+    for (int state = 0; state < PROCESS_STATE_COUNT; state++) {
+        const TierAccount *tier = &tiers[state];
+        if (!tier->current.valid) {
+            log_message("Tier %-10s: no accounting available", get_state_name((ProcessState)state));
+            continue;
+        }
+        log_message("Tier %-10s: CPU=%.1f%% Mem=%lldMB (anon %lluMB, file %lluMB) high=%llu max=%llu oom_kill=%llu",
+                    get_state_name((ProcessState)state), tier->cpu_percent,
+                    tier->current.memory_current / (1024 * 1024),
+                    tier->current.memory_anon / (1024 * 1024), tier->current.memory_file / (1024 * 1024),
+                    tier->current.events_high, tier->current.events_max, tier->current.events_oom_kill);
+    }
+    log_message("Memory protection: foreground low=%lldMB min=%lldMB, visible low=%lldMB",
+                tier_low[PROCESS_STATE_FOREGROUND] / (1024 * 1024),
+                tier_min[PROCESS_STATE_FOREGROUND] / (1024 * 1024),
+                tier_low[PROCESS_STATE_VISIBLE] / (1024 * 1024));
+}
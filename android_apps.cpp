@@ -0,0 +1,261 @@
+#include "android_scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+/*
+ * App grouping
+ *
+ * Tier, cgroup and kill decisions are made per app, not per process, so a
+ * browser's renderers share a tier and are killed together. Every tracked
+ * process gets an app_id, the pid of its app's leader:
+ *
+ *   1. Members of the same systemd app unit (an app-*.scope or app-*.service,
+ *      or any unit under app.slice) form one app, led by its oldest member.
+ *      A session-N.scope is not an app: an ssh login or a window manager
+ *      without per-app scopes would otherwise become one app.
+ *   2. Otherwise the process joins its launch lineage: the topmost tracked
+ *      ancestor in the same session. The walk stops at system services,
+ *      shells and terminals, so a session manager, launcher or terminal does
+ *      not absorb every app it starts.
+ *
+ * The app's score is its most important member's score; decide_app_state()
+ * turns that into one tier for all members. An app is killed through its
+ * cgroup.kill, which also takes helpers we never tracked and processes that
+ * fork mid-kill; without cgroup.kill its tracked members get SIGTERM.
+ *
+ * Each app also gets its own child cgroup under its tier, <tier>/app-<app_id>,
+ * so memory.max and cpu.weight are set per app rather than on the shared tier.
+ * Moving an app between tiers migrates everything in its old cgroup, tracked
+ * or not (helpers it forked after attach), into the app's cgroup under the
+ * new tier; the old one is then empty and removed. cgroup v2 only renames a
+ * cgroup within its parent, so the move is done pid by pid.
+ */
+
+// Processes that start unrelated programs for the user (matched on comm)
+static const char *const lineage_barriers[] = {
+    "sh", "bash", "dash", "zsh", "fish", "ksh", "tcsh", "csh", "login", "sshd", "sshd-session",
+    "tmux: server", "screen", "gnome-terminal-", "konsole", "xterm", "xfce4-terminal",
+    "alacritty", "kitty", "foot", "wezterm-gui", "terminator", "tilix", "urxvt", "st",
+};
+
+static bool is_lineage_barrier(const TrackedProcess *proc) {
+    for (size_t i = 0; i < sizeof(lineage_barriers) / sizeof(lineage_barriers[0]); i++) {
+        if (strcmp(proc->name, lineage_barriers[i]) == 0) return true;
+    }
+    return false;
+}
+
+// Length of the cgroup path up to and including its systemd app unit, 0 if none
+int app_unit_length(const char *cgroup) {
+    bool in_app_slice = false;
+    const char *component = cgroup;
+    while (*component == '/') component++;
+    while (*component) {
+        size_t len = strcspn(component, "/");
+        bool slice = (len > 6 && strncmp(component + len - 6, ".slice", 6) == 0);
+        bool app_unit = (in_app_slice && !slice) ||
+            (len > 4 && strncmp(component, "app-", 4) == 0 &&
+             ((len > 6 && strncmp(component + len - 6, ".scope", 6) == 0) ||
+              (len > 8 && strncmp(component + len - 8, ".service", 8) == 0)));
+        if (app_unit) return (int)(component + len - cgroup);
+        // Slices nested in app.slice (app-gnome.slice) are still inside it
+        if (slice) in_app_slice = in_app_slice || (len == 9 && strncmp(component, "app.slice", 9) == 0);
+        component += len;
+        while (*component == '/') component++;
+    }
+    return 0;
+}
+
+// Topmost tracked ancestor that still belongs to the same app
+static pid_t lineage_root(const TrackedProcess *proc) {
+    const TrackedProcess *root = proc;
+    for (int depth = 0; depth < 16 && root->ppid > 1; depth++) {
+        const TrackedProcess *parent = find_tracked_process(root->ppid);
+        if (!parent || parent->sid != proc->sid || parent->is_system_service || parent->app_scope ||
+            is_lineage_barrier(parent)) break;
+        root = parent;
+    }
+    return root->pid;
+}
+
+void update_app_groups(void) {
+    for (int i = 0; i < process_count; i++) {
+        TrackedProcess *proc = &processes[i];
+        if (!proc->app_scope) {
+            proc->app_id = lineage_root(proc);
+            continue;
+        }
+
+        // Oldest member of the unit leads, so the id is stable while it lives.
+        // Sub-cgroups a unit creates for itself still belong to it
+        int unit_len = app_unit_length(proc->origin_cgroup);
+        const TrackedProcess *leader = proc;
+        for (int j = 0; j < process_count; j++) {
+            const TrackedProcess *other = &processes[j];
+            if (!other->app_scope || app_unit_length(other->origin_cgroup) != unit_len ||
+                strncmp(other->origin_cgroup, proc->origin_cgroup, unit_len) != 0) continue;
+            if (other->start_time < leader->start_time ||
+                (other->start_time == leader->start_time && other->pid < leader->pid)) {
+                leader = other;
+            }
+        }
+        proc->app_id = leader->pid;
+    }
+
+    // A leader must lead itself (deep chains can hit the depth limit); otherwise go alone
+    for (int i = 0; i < process_count; i++) {
+        TrackedProcess *proc = &processes[i];
+        const TrackedProcess *leader = find_tracked_process(proc->app_id);
+        if (!leader || leader->app_id != proc->app_id) proc->app_id = proc->pid;
+    }
+}
+
+int get_app_members(pid_t app_id, TrackedProcess **members, int max) {
+    int count = 0;
+    TrackedProcess *leader = find_tracked_process(app_id);
+    if (leader && leader->app_id == app_id) members[count++] = leader;
+
+    for (int i = 0; i < process_count && count < max; i++) {
+        if (processes[i].app_id == app_id && processes[i].pid != app_id) {
+            members[count++] = &processes[i];
+        }
+    }
+    return count;
+}
+
+ProcessState decide_app_state(TrackedProcess *const *members, int count, time_t now, float *app_score) {
+    // A leader's priority request speaks for the app; the other inputs are merged
+    float score = members[0]->importance_score;
+    int requested_priority = members[0]->requested_priority;
+    bool visible = members[0]->is_visible;
+    time_t prewarm_until = members[0]->prewarm_until;
+    for (int i = 1; i < count; i++) {
+        const TrackedProcess *member = members[i];
+        if (member->importance_score < score) score = member->importance_score;
+        if (member->is_visible) visible = true;
+        if (member->prewarm_until > prewarm_until) prewarm_until = member->prewarm_until;
+        if (requested_priority == 0) requested_priority = member->requested_priority;
+    }
+    *app_score = score;
+    return decide_state(score, requested_priority, visible, prewarm_until, now);
+}
+
+// Kills every member of an app that has been cached and idle for long enough
+int kill_idle_cached_app(pid_t app_id, time_t now) {
+    TrackedProcess *members[MAX_PROCESSES];
+    int count = get_app_members(app_id, members, MAX_PROCESSES);
+    if (count == 0) return 0;
+
+    for (int i = 0; i < count; i++) {
+        if (members[i]->state != PROCESS_STATE_CACHED || now - members[i]->last_active <= 300) return 0;
+    }
+
+    // The app cgroup's charge includes children we do not track; PSS is the fallback
+    long long footprint = app_memory_footprint(members[0]);
+    if (footprint >= 0) {
+        log_message("Memory pressure: Killing cached app [%s] PID %d with %d processes (cgroup %lldMB)",
+                    members[0]->name, app_id, count, footprint / (1024 * 1024));
+    } else {
+        long pss_kb = 0, swap_kb = 0;
+        for (int i = 0; i < count; i++) {
+            get_process_footprint(members[i], now);
+            pss_kb += members[i]->pss_kb;
+            swap_kb += members[i]->swap_kb;
+        }
+        log_message("Memory pressure: Killing cached app [%s] PID %d with %d processes (PSS %ldMB, swap %ldMB)",
+                    members[0]->name, app_id, count, pss_kb / 1024, swap_kb / 1024);
+    }
+    // Processes are removed from the table in the main loop
+    const char *cgroup = members[0]->cgroup_path;
+    if (cgroup_capable(CGROUP_CAP_KILL) && is_app_cgroup(cgroup) &&
+        write_cgroup_file(cgroup, "cgroup.kill", "1") == 0) {
+        return count;
+    }
+    for (int i = 0; i < count; i++) {
+        kill(members[i]->pid, SIGTERM);
+    }
+    return count;
+}
+
+void app_cgroup_path(ProcessState state, pid_t app_id, char *buf, size_t size) {
+    snprintf(buf, size, "%s/" APP_CGROUP_PREFIX "%d", get_cgroup_for_state(state), app_id);
+}
+
+bool is_app_cgroup(const char *path) {
+    const char *base = strrchr(path, '/');
+    return base && strncmp(base + 1, APP_CGROUP_PREFIX, strlen(APP_CGROUP_PREFIX)) == 0;
+}
+
+// Creates the app's cgroup on first use and moves the process into it
+int enter_app_cgroup(const char *path, pid_t pid) {
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+        log_message("Failed to create app cgroup %s: %s", path, strerror(errno));
+        return -1;
+    }
+    init_app_uclamp(path);
+    return assign_to_cgroup(path, pid);
+}
+
+// Moves every process left in an app's old cgroup into its new one. Passes
+// repeat while processes keep moving, to catch forks racing the migration
+int migrate_app_cgroup(const char *from, const char *to) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/cgroup.procs", from);
+
+    int moved = 0;
+    for (int pass = 0; pass < 3; pass++) {
+        FILE *f = fopen(path, "r");
+        if (!f) break;
+        int moved_now = 0;
+        pid_t pid;
+        while (fscanf(f, "%d", &pid) == 1) {
+            if (assign_to_cgroup(to, pid) == 0) moved_now++;
+        }
+        fclose(f);
+        moved += moved_now;
+        if (moved_now == 0) break;
+    }
+    return moved;
+}
+
+// Removes an app cgroup once its last process has left; a populated one stays
+void remove_app_cgroup(const char *path) {
+    if (!is_app_cgroup(path)) return;
+    if (rmdir(path) != 0 && errno != EBUSY && errno != ENOENT) {
+        log_message("Failed to remove app cgroup %s: %s", path, strerror(errno));
+    }
+}
+
+// Removes app cgroups no tracked process is placed in (apps that exited
+// while their cgroup was still populated, or placements from a previous run)
+int prune_app_cgroups(void) {
+    int removed = 0;
+    for (int state = 0; state < PROCESS_STATE_COUNT; state++) {
+        const char *tier = get_cgroup_for_state((ProcessState)state);
+        DIR *dir = opendir(tier);
+        if (!dir) continue;
+
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (strncmp(entry->d_name, APP_CGROUP_PREFIX, strlen(APP_CGROUP_PREFIX)) != 0) continue;
+
+            char path[512];
+            snprintf(path, sizeof(path), "%s/%s", tier, entry->d_name);
+            bool in_use = false;
+            for (int i = 0; i < process_count && !in_use; i++) {
+                in_use = (strcmp(processes[i].cgroup_path, path) == 0);
+            }
+            if (!in_use && rmdir(path) == 0) removed++;
+        }
+        closedir(dir);
+    }
+    if (removed > 0) log_message("Removed %d unused app cgroups", removed);
+    return removed;
+}
@@ -0,0 +1,208 @@
+#include "android_scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+
+/*
+ * cgroup v2 setup and capability detection
+ *
+ * Tier and app cgroups only have control files for controllers that every
+ * ancestor enables in cgroup.subtree_control. At startup we check that the
+ * unified hierarchy is mounted at CGROUP_ROOT, enable what we need level by
+ * level, and then probe for the control files themselves:
+ *
+ *   root  -> tiers   cpu memory io cpuset   (cpuset only for thermal caps)
+ *   tier  -> apps    cpu memory io
+ *
+ * Files that depend on kernel config or version rather than on a controller
+ * (uclamp, swap, zswap, proactive reclaim, cgroup.kill) are probed separately
+ * in the tiers. The
+ * result is a CGROUP_CAP_* mask. Actuation that depends on a missing
+ * controller is skipped rather than retried as a failing write every cycle.
+ */
+
+#ifndef CGROUP2_SUPER_MAGIC
+#define CGROUP2_SUPER_MAGIC 0x63677270
+#endif
+
+typedef struct {
+    int cap;
+    const char *name;
+    const char *tier_file;       // Probed in every tier
+    const char *app_file;        // Probed in the tiers' children, NULL = tier only
+} CgroupController;
+
+static const CgroupController controllers[] = {
+    { CGROUP_CAP_CPU,    "cpu",    "cpu.max",     "cpu.weight" },
+    { CGROUP_CAP_MEMORY, "memory", "memory.max",  "memory.max" },
+    { CGROUP_CAP_IO,     "io",     "io.stat",     "io.stat" },
+    { CGROUP_CAP_CPUSET, "cpuset", "cpuset.cpus", NULL },
+};
+
+#define CONTROLLER_COUNT (int)(sizeof(controllers) / sizeof(controllers[0]))
+
+typedef struct {
+    int cap;
+    const char *name;
+    const char *tier_file;
+} CgroupFeature;
+
+static const CgroupFeature features[] = {
+    { CGROUP_CAP_UCLAMP,  "uclamp",  "cpu.uclamp.min" },     // CONFIG_UCLAMP_TASK_GROUP
+    { CGROUP_CAP_SWAP,    "swap",    "memory.swap.max" },    // CONFIG_SWAP
+    { CGROUP_CAP_ZSWAP,   "zswap",   "memory.zswap.max" },   // CONFIG_ZSWAP
+    { CGROUP_CAP_RECLAIM, "reclaim", "memory.reclaim" },     // Linux 5.19+
+    { CGROUP_CAP_KILL,    "kill",    "cgroup.kill" },        // Linux 5.14+
+};
+
+#define FEATURE_COUNT (int)(sizeof(features) / sizeof(features[0]))
+
+static int cgroup_caps = 0;
+
+bool cgroup_capable(int caps) {
+    return (cgroup_caps & caps) == caps;
+}
+
+static bool cgroup_file_exists(const char *cgroup_path, const char *file) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", cgroup_path, file);
+    return access(path, F_OK) == 0;
+}
+
+// True if the space-separated controller list in <cgroup>/<file> names controller
+static bool controller_listed(const char *cgroup_path, const char *file, const char *controller) {
+    char path[512], buf[256];
+    snprintf(path, sizeof(path), "%s/%s", cgroup_path, file);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return false;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) return false;
+    buf[n] = '\0';
+
+    size_t len = strlen(controller);
+    for (char *word = strtok(buf, " \n"); word; word = strtok(NULL, " \n")) {
+        if (strlen(word) == len && strncmp(word, controller, len) == 0) return true;
+    }
+    return false;
+}
+
+// Enables each controller separately so one refusal does not block the rest
+static void enable_controllers(const char *cgroup_path, bool include_cpuset) {
+    for (int i = 0; i < CONTROLLER_COUNT; i++) {
+        const CgroupController *ctrl = &controllers[i];
+        if (!ctrl->app_file && !include_cpuset) continue;
+        if (controller_listed(cgroup_path, "cgroup.subtree_control", ctrl->name)) continue;
+        if (!controller_listed(cgroup_path, "cgroup.controllers", ctrl->name)) continue;
+
+        char value[32];
+        snprintf(value, sizeof(value), "+%s", ctrl->name);
+        if (write_cgroup_file(cgroup_path, "cgroup.subtree_control", value) != 0) {
+            log_message("Failed to enable %s controller below %s: %s", ctrl->name, cgroup_path, strerror(errno));
+        }
+    }
+}
+
+// A cgroup with controllers enabled for its children may not hold processes
+// itself, so anything left directly in a tier is moved to its launch child
+static void evacuate_tier(const char *tier, const char *launch) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/cgroup.procs", tier);
+    FILE *f = fopen(path, "r");
+    if (!f) return;
+
+    int moved = 0;
+    pid_t pid;
+    while (fscanf(f, "%d", &pid) == 1) {
+        if (assign_to_cgroup(launch, pid) == 0) moved++;
+    }
+    fclose(f);
+    if (moved > 0) log_message("Moved %d processes from %s to %s", moved, tier, launch);
+}
+
+void setup_cgroups() {
+    cgroup_caps = 0;
+
+    struct statfs fs;
+    if (statfs(CGROUP_ROOT, &fs) != 0) {
+        log_message("cgroup: %s unavailable (%s); tier placement disabled", CGROUP_ROOT, strerror(errno));
+        return;
+    }
+    if ((unsigned long)fs.f_type != (unsigned long)CGROUP2_SUPER_MAGIC) {
+        log_message("cgroup: %s is not a cgroup v2 (unified) mount; tier placement disabled", CGROUP_ROOT);
+        return;
+    }
+
+    enable_controllers(CGROUP_ROOT, true);
+
+    const char *cgroups[] = {
+        CGROUP_FOREGROUND, CGROUP_VISIBLE, CGROUP_SERVICE,
+        CGROUP_BACKGROUND, CGROUP_CACHED
+    };
+
+    int usable = 0;
+    int caps = 0;
+    for (int c = 0; c < CONTROLLER_COUNT; c++) caps |= controllers[c].cap;
+    for (int f = 0; f < FEATURE_COUNT; f++) caps |= features[f].cap;
+    for (int i = 0; i < 5; i++) {
+        if (mkdir(cgroups[i], 0755) == 0) {
+            log_message("Created cgroup directory: %s", cgroups[i]);
+        } else if (errno != EEXIST) {
+            log_message("Failed to create cgroup directory %s: %s", cgroups[i], strerror(errno));
+            continue;
+        }
+
+        char launch[256];
+        snprintf(launch, sizeof(launch), "%s/" LAUNCH_CGROUP, cgroups[i]);
+        if (mkdir(launch, 0755) != 0 && errno != EEXIST) {
+            log_message("Failed to create cgroup directory %s: %s", launch, strerror(errno));
+            continue;
+        }
+        evacuate_tier(cgroups[i], launch);
+        enable_controllers(cgroups[i], false);
+        usable++;
+
+        // A controller counts only if its files showed up at every level that uses it
+        for (int c = 0; c < CONTROLLER_COUNT; c++) {
+            const CgroupController *ctrl = &controllers[c];
+            if (!cgroup_file_exists(cgroups[i], ctrl->tier_file) ||
+                (ctrl->app_file && !cgroup_file_exists(launch, ctrl->app_file))) {
+                caps &= ~ctrl->cap;
+            }
+        }
+        for (int f = 0; f < FEATURE_COUNT; f++) {
+            if (!cgroup_file_exists(cgroups[i], features[f].tier_file)) caps &= ~features[f].cap;
+        }
+    }
+
+    if (usable < 5) {
+        log_message("cgroup: only %d of 5 tiers usable; tier placement disabled", usable);
+        return;
+    }
+    cgroup_caps = CGROUP_CAP_TIERS | caps;
+    cgroup_report();
+    log_message("cgroup hierarchy initialized");
+}
+
+void cgroup_report(void) {
+    if (!cgroup_capable(CGROUP_CAP_TIERS)) {
+        log_message("cgroup: tiers unavailable, placement and resource controls disabled");
+        return;
+    }
+
+    char enabled[128] = "", missing[128] = "";
+    for (int i = 0; i < CONTROLLER_COUNT + FEATURE_COUNT; i++) {
+        int cap = (i < CONTROLLER_COUNT) ? controllers[i].cap : features[i - CONTROLLER_COUNT].cap;
+        const char *name = (i < CONTROLLER_COUNT) ? controllers[i].name : features[i - CONTROLLER_COUNT].name;
+        char *list = cgroup_capable(cap) ? enabled : missing;
+        if (list[0]) strcat(list, " ");
+        strcat(list, name);
+    }
+    log_message("cgroup v2 at %s: [%s]%s%s%s", CGROUP_ROOT, enabled,
+                missing[0] ? ", unavailable [" : "", missing, missing[0] ? "]" : "");
+}
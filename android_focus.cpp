@@ -0,0 +1,712 @@
+#include "android_scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <setjmp.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <pwd.h>
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+
+/*
+ * Focus providers
+ *
+ * The monitor learns which app has focus through one of these backends:
+ *
+ *   x11     libX11 is loaded with dlopen() the first time focus is needed, so
+ *           simulator-only runs and headless hosts never load it. Focus
+ *           changes arrive as _NET_ACTIVE_WINDOW PropertyNotify events.
+ *   socket  A compositor, launcher or script pushes "<pid>" or "focus <pid>"
+ *           datagrams to FOCUS_SOCKET_PATH (or $ANDROID_SCHED_FOCUS_SOCKET).
+ *           This works on Wayland and headless hosts, e.g.
+ *             echo 1234 | socat - UNIX-SENDTO:/run/android_scheduler/focus.sock
+ *           "visible <pid> <pid> ..." replaces the set of on-screen apps.
+ *           The socket is root:<session group> 0660, and a datagram is only
+ *           accepted when its sender (SCM_CREDENTIALS) is root or the session
+ *           user: $ANDROID_SCHED_FOCUS_UID, else the user who ran sudo or
+ *           pkexec. With neither, only root may send.
+ *   none    No focus information; scoring relies on activity alone.
+ *
+ * $ANDROID_SCHED_FOCUS picks a backend by name. Otherwise x11 is tried when
+ * $DISPLAY is set, then socket, then none.
+ *
+ * Besides focus, a provider reports which apps have a window on screen. The
+ * x11 backend keeps _NET_CLIENT_LIST cached and follows each client's map
+ * state, visibility and _NET_WM_STATE_HIDDEN from events, so building the
+ * visible set costs no round trips. Under a compositing window manager every
+ * mapped window counts as unobscured, since the X server cannot tell.
+ *
+ * Xlib's default IO error handler calls exit() when the X server goes away,
+ * which would leave every cgroup placement, OOM score and thermal cap behind.
+ * Every x11 entry point therefore arms a jump buffer that our handler longjmps
+ * to. The dead connection is then abandoned (its fd closed, the Display never
+ * touched again), the socket provider (or none) takes over, and x11 is retried
+ * every FOCUS_X11_RETRY_SECS.
+ */
+
+typedef struct {
+    const char *name;
+    bool (*open)(void);              // False if the backend cannot work here
+    void (*close)(void);
+    int (*event_fd)(void);           // Pollable fd for focus changes, -1 if none
+    bool (*pending)(void);           // Events already buffered in user space
+    pid_t (*poll_event)(void);       // New focus after an event, -1 if unchanged
+    pid_t (*current)(void);          // Focused pid now, -1 if unknown
+    int (*visible)(pid_t *pids, int max);  // Pids with a window on screen
+} FocusProvider;
+
+/* ---- x11 ---- */
+
+// The handful of libX11 entry points we use, resolved at runtime
+static struct {
+    void *handle;
+    Display *(*OpenDisplay)(const char *);
+    int (*CloseDisplay)(Display *);
+    Atom (*InternAtom)(Display *, const char *, Bool);
+    int (*GetWindowProperty)(Display *, Window, Atom, long, long, Bool, Atom, Atom *, int *,
+                             unsigned long *, unsigned long *, unsigned char **);
+    int (*Free)(void *);
+    int (*SelectInput)(Display *, Window, long);
+    int (*Flush)(Display *);
+    int (*Pending)(Display *);
+    int (*NextEvent)(Display *, XEvent *);
+    int (*GetInputFocus)(Display *, Window *, int *);
+    Status (*QueryTree)(Display *, Window, Window *, Window *, Window **, unsigned int *);
+    Status (*GetWindowAttributes)(Display *, Window, XWindowAttributes *);
+    XErrorHandler (*SetErrorHandler)(XErrorHandler);
+    XIOErrorHandler (*SetIOErrorHandler)(XIOErrorHandler);
+} xlib;
+
+typedef struct {
+    Window window;
+    pid_t pid;
+    bool mapped;
+    bool obscured;               // Fully covered by other windows
+    bool hidden;                 // _NET_WM_STATE_HIDDEN (minimised)
+} ClientWindow;
+
+static Display *x_display = NULL;
+static Atom net_active_window = None;
+static Atom net_wm_pid = None;
+static Atom net_client_list = None;
+static Atom net_wm_state = None;
+static Atom net_wm_state_hidden = None;
+static bool focus_changed = false;
+static ClientWindow clients[MAX_CLIENT_WINDOWS];
+static int client_count = 0;
+static jmp_buf x_io_error;
+static bool x_guard_armed = false;
+
+static bool load_symbol(void *slot, const char *symbol) {
+    void *address = dlsym(xlib.handle, symbol);
+    if (!address) return false;
+    memcpy(slot, &address, sizeof(address));
+    return true;
+}
+
+static bool load_xlib(void) {
+    if (xlib.handle) return true;
+    xlib.handle = dlopen(X11_LIBRARY, RTLD_NOW | RTLD_LOCAL);
+    if (!xlib.handle) {
+        log_message("Focus: cannot load %s: %s", X11_LIBRARY, dlerror());
+        return false;
+    }
+    bool ok = load_symbol(&xlib.OpenDisplay, "XOpenDisplay") &&
+              load_symbol(&xlib.CloseDisplay, "XCloseDisplay") &&
+              load_symbol(&xlib.InternAtom, "XInternAtom") &&
+              load_symbol(&xlib.GetWindowProperty, "XGetWindowProperty") &&
+              load_symbol(&xlib.Free, "XFree") &&
+              load_symbol(&xlib.SelectInput, "XSelectInput") &&
+              load_symbol(&xlib.Flush, "XFlush") &&
+              load_symbol(&xlib.Pending, "XPending") &&
+              load_symbol(&xlib.NextEvent, "XNextEvent") &&
+              load_symbol(&xlib.GetInputFocus, "XGetInputFocus") &&
+              load_symbol(&xlib.QueryTree, "XQueryTree") &&
+              load_symbol(&xlib.GetWindowAttributes, "XGetWindowAttributes") &&
+              load_symbol(&xlib.SetErrorHandler, "XSetErrorHandler") &&
+              load_symbol(&xlib.SetIOErrorHandler, "XSetIOErrorHandler");
+    if (!ok) {
+        log_message("Focus: %s is missing required symbols", X11_LIBRARY);
+        dlclose(xlib.handle);
+        xlib.handle = NULL;
+    }
+    return ok;
+}
+
+// Client windows can vanish between an event and our request; that is not fatal
+static int ignore_x_error(Display *, XErrorEvent *) {
+    return 0;
+}
+
+// Xlib exits if this returns, so it never does while a guarded call is running
+static int x_connection_error(Display *) {
+    if (x_guard_armed) longjmp(x_io_error, 1);
+    return 0;
+}
+
+// The Display is unusable after an IO error; only its fd is reclaimed
+static void x11_connection_lost(void) {
+    x_guard_armed = false;
+    if (x_display) close(ConnectionNumber(x_display));
+    x_display = NULL;
+    client_count = 0;
+    focus_changed = false;
+    log_message("Focus: lost the X server connection");
+}
+
+// Runs an Xlib-calling function with the IO error guard armed; false if the connection died
+static bool x11_guarded(void (*call)(void *), void *arg) {
+    if (setjmp(x_io_error) != 0) {
+        x11_connection_lost();
+        return false;
+    }
+    x_guard_armed = true;
+    call(arg);
+    x_guard_armed = false;
+    return true;
+}
+
+static pid_t window_pid(Window window) {
+    Atom actual_type;
+    int actual_format;
+    unsigned long nitems, bytes_after;
+    unsigned char *prop = NULL;
+    pid_t pid = -1;
+
+    if (xlib.GetWindowProperty(x_display, window, net_wm_pid, 0, 1, False, XA_CARDINAL,
+                               &actual_type, &actual_format, &nitems, &bytes_after, &prop) == Success && prop) {
+        if (nitems == 1) pid = (pid_t)*(unsigned long *)prop;
+        xlib.Free(prop);
+    }
+    return pid;
+}
+
+static bool window_hidden(Window window) {
+    Atom actual_type;
+    int actual_format;
+    unsigned long nitems, bytes_after;
+    unsigned char *prop = NULL;
+    bool hidden = false;
+
+    if (xlib.GetWindowProperty(x_display, window, net_wm_state, 0, 32, False, XA_ATOM,
+                               &actual_type, &actual_format, &nitems, &bytes_after, &prop) == Success && prop) {
+        for (unsigned long i = 0; i < nitems; i++) {
+            if (((Atom *)prop)[i] == net_wm_state_hidden) hidden = true;
+        }
+        xlib.Free(prop);
+    }
+    return hidden;
+}
+
+static ClientWindow *find_client(Window window) {
+    for (int i = 0; i < client_count; i++) {
+        if (clients[i].window == window) return &clients[i];
+    }
+    return NULL;
+}
+
+// Re-reads _NET_CLIENT_LIST, keeping what we already know about existing windows
+static void refresh_client_list(void) {
+    Atom actual_type;
+    int actual_format;
+    unsigned long nitems, bytes_after;
+    unsigned char *prop = NULL;
+
+    if (xlib.GetWindowProperty(x_display, DefaultRootWindow(x_display), net_client_list, 0, MAX_CLIENT_WINDOWS,
+                               False, XA_WINDOW, &actual_type, &actual_format,
+                               &nitems, &bytes_after, &prop) != Success || !prop) {
+        client_count = 0;
+        return;
+    }
+
+    ClientWindow updated[MAX_CLIENT_WINDOWS];
+    int count = 0;
+    for (unsigned long i = 0; i < nitems && count < MAX_CLIENT_WINDOWS; i++) {
+        Window window = ((Window *)prop)[i];
+        const ClientWindow *known = find_client(window);
+        if (known) {
+            updated[count++] = *known;
+            continue;
+        }
+
+        // New client: subscribe first so no change is missed, then read its state
+        xlib.SelectInput(x_display, window, StructureNotifyMask | VisibilityChangeMask | PropertyChangeMask);
+        XWindowAttributes attrs;
+        ClientWindow *client = &updated[count++];
+        client->window = window;
+        client->pid = window_pid(window);
+        client->mapped = xlib.GetWindowAttributes(x_display, window, &attrs) && attrs.map_state == IsViewable;
+        client->obscured = false;
+        client->hidden = window_hidden(window);
+    }
+    xlib.Free(prop);
+
+    memcpy(clients, updated, count * sizeof(ClientWindow));
+    client_count = count;
+}
+
+static void x11_setup_connection(void *) {
+    net_active_window = xlib.InternAtom(x_display, "_NET_ACTIVE_WINDOW", False);
+    net_wm_pid = xlib.InternAtom(x_display, "_NET_WM_PID", False);
+    net_client_list = xlib.InternAtom(x_display, "_NET_CLIENT_LIST", False);
+    net_wm_state = xlib.InternAtom(x_display, "_NET_WM_STATE", False);
+    net_wm_state_hidden = xlib.InternAtom(x_display, "_NET_WM_STATE_HIDDEN", False);
+    xlib.SelectInput(x_display, DefaultRootWindow(x_display), PropertyChangeMask);
+    refresh_client_list();
+    xlib.Flush(x_display);
+}
+
+static bool x11_open(void) {
+    if (!load_xlib()) return false;
+
+    x_display = xlib.OpenDisplay(NULL);
+    if (!x_display) {
+        log_message("Focus: could not open X display");
+        return false;
+    }
+    xlib.SetErrorHandler(ignore_x_error);
+    xlib.SetIOErrorHandler(x_connection_error);
+    return x11_guarded(x11_setup_connection, NULL);
+}
+
+static void x11_close_display(void *) {
+    xlib.CloseDisplay(x_display);
+}
+
+static void x11_close(void) {
+    if (x_display && x11_guarded(x11_close_display, NULL)) {
+        x_display = NULL;
+    }
+    client_count = 0;
+}
+
+static int x11_event_fd(void) {
+    return x_display ? ConnectionNumber(x_display) : -1;
+}
+
+static void x11_count_pending(void *pending) {
+    *(int *)pending = xlib.Pending(x_display);
+}
+
+static bool x11_pending(void) {
+    int pending = 0;
+    return x_display && x11_guarded(x11_count_pending, &pending) && pending > 0;
+}
+
+static pid_t read_active_window_pid(void) {
+    Atom actual_type;
+    int actual_format;
+    unsigned long nitems, bytes_after;
+    unsigned char *prop = NULL;
+    Window active = None;
+
+    if (xlib.GetWindowProperty(x_display, DefaultRootWindow(x_display), net_active_window,
+                               0, 1, False, XA_WINDOW, &actual_type, &actual_format,
+                               &nitems, &bytes_after, &prop) == Success && prop) {
+        if (nitems == 1) active = *(Window *)prop;
+        xlib.Free(prop);
+    }
+    return active == None ? -1 : window_pid(active);
+}
+
+// Applies every queued event to the cached client state
+static void x11_drain_events(void *) {
+    bool list_changed = false;
+    while (xlib.Pending(x_display) > 0) {
+        XEvent event;
+        xlib.NextEvent(x_display, &event);
+        ClientWindow *client;
+        switch (event.type) {
+        case PropertyNotify:
+            if (event.xproperty.atom == net_active_window) {
+                focus_changed = true;
+            } else if (event.xproperty.atom == net_client_list) {
+                list_changed = true;
+            } else if (event.xproperty.atom == net_wm_state && (client = find_client(event.xproperty.window))) {
+                client->hidden = window_hidden(client->window);
+            }
+            break;
+        case MapNotify:
+            if ((client = find_client(event.xmap.window))) client->mapped = true;
+            break;
+        case UnmapNotify:
+            if ((client = find_client(event.xunmap.window))) client->mapped = false;
+            break;
+        case VisibilityNotify:
+            if ((client = find_client(event.xvisibility.window))) {
+                client->obscured = (event.xvisibility.state == VisibilityFullyObscured);
+            }
+            break;
+        }
+    }
+    if (list_changed) refresh_client_list();
+}
+
+static void x11_read_active(void *pid) {
+    *(pid_t *)pid = read_active_window_pid();
+}
+
+static pid_t x11_poll_event(void) {
+    if (!x_display) return -1;
+
+    // Only the latest active window matters
+    if (!x11_guarded(x11_drain_events, NULL) || !focus_changed) return -1;
+    focus_changed = false;
+    pid_t pid = -1;
+    return x11_guarded(x11_read_active, &pid) ? pid : -1;
+}
+
+static int x11_visible(pid_t *pids, int max) {
+    if (!x_display || !x11_guarded(x11_drain_events, NULL)) return 0;
+
+    int count = 0;
+    for (int i = 0; i < client_count && count < max; i++) {
+        const ClientWindow *client = &clients[i];
+        if (client->pid <= 0 || !client->mapped || client->obscured || client->hidden) continue;
+
+        bool duplicate = false;
+        for (int j = 0; j < count; j++) {
+            if (pids[j] == client->pid) duplicate = true;
+        }
+        if (!duplicate) pids[count++] = client->pid;
+    }
+    return count;
+}
+
+static pid_t x11_focused_pid(void) {
+    Window root = DefaultRootWindow(x_display);
+    Window focused = None;
+    int revert_to;
+    xlib.GetInputFocus(x_display, &focused, &revert_to);
+    if (focused == None || focused == PointerRoot) {
+        // Fall back to the window manager's idea of the active window
+        return read_active_window_pid();
+    }
+
+    // The focused window may be a child of the application's top-level window
+    Window current = focused;
+    while (current != None && current != root) {
+        pid_t pid = window_pid(current);
+        if (pid > 0) return pid;
+
+        Window root_return, parent_return;
+        Window *children_return = NULL;
+        unsigned int nchildren_return;
+        if (xlib.QueryTree(x_display, current, &root_return, &parent_return,
+                           &children_return, &nchildren_return) == 0) {
+            log_message("ERROR: XQueryTree failed");
+            break;
+        }
+        if (children_return) xlib.Free(children_return);
+        current = parent_return;
+    }
+    return read_active_window_pid();
+}
+
+static void x11_read_focused(void *pid) {
+    *(pid_t *)pid = x11_focused_pid();
+}
+
+static pid_t x11_current(void) {
+    pid_t pid = -1;
+    if (!x_display || !x11_guarded(x11_read_focused, &pid)) return -1;
+    return pid;
+}
+
+/* ---- socket ---- */
+
+static int focus_socket = -1;
+static char focus_socket_path[108];
+static uid_t session_uid = 0;            // Besides root, the only uid allowed to send
+static pid_t pushed_pid = -1;
+static bool pushed_focus_changed = false;
+static pid_t pushed_visible[MAX_CLIENT_WINDOWS];
+static int pushed_visible_count = 0;
+
+static uid_t find_session_uid(void) {
+    const char *vars[] = { "ANDROID_SCHED_FOCUS_UID", "SUDO_UID", "PKEXEC_UID" };
+    for (size_t i = 0; i < sizeof(vars) / sizeof(vars[0]); i++) {
+        const char *value = getenv(vars[i]);
+        char *end;
+        if (!value || !value[0]) continue;
+        long uid = strtol(value, &end, 10);
+        if (*end == '\0' && uid > 0) return (uid_t)uid;
+    }
+    return 0;
+}
+
+// Receives one datagram, or -2 for one from a sender that may not push focus
+static ssize_t socket_receive(char *buf, size_t size) {
+    struct iovec iov = { buf, size };
+    union {
+        char buf[CMSG_SPACE(sizeof(struct ucred))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t len = recvmsg(focus_socket, &msg, 0);
+    if (len < 0) return len;
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_CREDENTIALS) continue;
+        struct ucred cred;
+        memcpy(&cred, CMSG_DATA(cmsg), sizeof(cred));
+        if (cred.uid == 0 || (session_uid != 0 && cred.uid == session_uid)) return len;
+        return -2;
+    }
+    return -2;
+}
+
+static bool socket_open(void) {
+    const char *path = getenv("ANDROID_SCHED_FOCUS_SOCKET");
+    if (!path || !path[0]) {
+        path = FOCUS_SOCKET_PATH;
+        mkdir("/run/android_scheduler", 0755);
+    }
+    if (strlen(path) >= sizeof(focus_socket_path)) {
+        log_message("Focus: socket path %s is too long", path);
+        return false;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) return false;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);  // Left over from a previous run
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        log_message("Focus: cannot bind %s: %s", path, strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    // The kernel attaches the sender's credentials to every datagram
+    int on = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_PASSCRED, &on, sizeof(on)) == -1) {
+        log_message("Focus: cannot check senders on %s: %s", path, strerror(errno));
+        close(fd);
+        unlink(path);
+        return false;
+    }
+
+    session_uid = find_session_uid();
+    struct passwd *pw = session_uid != 0 ? getpwuid(session_uid) : NULL;
+    gid_t gid = pw ? pw->pw_gid : 0;
+    if (chown(path, 0, gid) == -1 || chmod(path, 0660) == -1) {
+        log_message("Focus: cannot set owner and mode of %s: %s", path, strerror(errno));
+        close(fd);
+        unlink(path);
+        return false;
+    }
+
+    focus_socket = fd;
+    strcpy(focus_socket_path, path);
+    if (session_uid != 0) {
+        log_message("Focus: accepting focus updates on %s from root and uid %d", path, (int)session_uid);
+    } else {
+        log_message("Focus: accepting focus updates on %s from root only", path);
+    }
+    return true;
+}
+
+static void socket_close(void) {
+    if (focus_socket != -1) {
+        close(focus_socket);
+        unlink(focus_socket_path);
+        focus_socket = -1;
+    }
+}
+
+static int socket_event_fd(void) {
+    return focus_socket;
+}
+
+static bool socket_pending(void) {
+    return false;
+}
+
+static void socket_drain(void) {
+    if (focus_socket == -1) return;
+
+    // Drain the queue; the last well-formed message of each kind wins
+    pid_t latest = -1;
+    int rejected = 0;
+    char buf[512];
+    ssize_t len;
+    while ((len = socket_receive(buf, sizeof(buf) - 1)) != -1) {
+        if (len < 0) {
+            rejected++;
+            continue;
+        }
+        buf[len] = '\0';
+        const char *p = buf;
+        char *end;
+        if (strncmp(p, "visible", 7) == 0) {
+            p += 7;
+            pushed_visible_count = 0;
+            long pid;
+            while (pushed_visible_count < MAX_CLIENT_WINDOWS && (pid = strtol(p, &end, 10)) > 0 && end != p) {
+                pushed_visible[pushed_visible_count++] = (pid_t)pid;
+                p = end;
+            }
+            continue;
+        }
+        if (strncmp(p, "focus", 5) == 0) p += 5;
+        long pid = strtol(p, &end, 10);
+        if (end != p && pid > 0) latest = (pid_t)pid;
+    }
+    if (rejected > 0) log_message("Focus: ignored %d updates from senders other than root or the session user", rejected);
+    if (latest != -1 && latest != pushed_pid) {
+        pushed_pid = latest;
+        pushed_focus_changed = true;
+    }
+}
+
+static pid_t socket_poll_event(void) {
+    socket_drain();
+    if (!pushed_focus_changed) return -1;
+    pushed_focus_changed = false;
+    return pushed_pid;
+}
+
+static pid_t socket_current(void) {
+    socket_drain();
+    if (pushed_pid > 0) {
+        char path[32];
+        snprintf(path, sizeof(path), "/proc/%d", pushed_pid);
+        if (access(path, F_OK) != 0) pushed_pid = -1;  // The focused app has exited
+    }
+    return pushed_pid;
+}
+
+static int socket_visible(pid_t *pids, int max) {
+    socket_drain();
+    int count = pushed_visible_count < max ? pushed_visible_count : max;
+    memcpy(pids, pushed_visible, count * sizeof(pid_t));
+    return count;
+}
+
+/* ---- none ---- */
+
+static bool none_open(void) { return true; }
+static void none_close(void) {}
+static int none_event_fd(void) { return -1; }
+static bool none_pending(void) { return false; }
+static pid_t none_poll_event(void) { return -1; }
+static pid_t none_current(void) { return -1; }
+static int none_visible(pid_t *, int) { return 0; }
+
+static const FocusProvider providers[] = {
+    { "x11", x11_open, x11_close, x11_event_fd, x11_pending, x11_poll_event, x11_current, x11_visible },
+    { "socket", socket_open, socket_close, socket_event_fd, socket_pending, socket_poll_event, socket_current,
+      socket_visible },
+    { "none", none_open, none_close, none_event_fd, none_pending, none_poll_event, none_current, none_visible },
+};
+#define PROVIDER_COUNT (int)(sizeof(providers) / sizeof(providers[0]))
+
+static const FocusProvider *provider = NULL;
+static time_t x11_retry_at = 0;              // Reconnect time after a lost X connection, 0 = none
+
+static const FocusProvider *find_provider(const char *name) {
+    for (int i = 0; i < PROVIDER_COUNT; i++) {
+        if (strcmp(providers[i].name, name) == 0) return &providers[i];
+    }
+    return NULL;
+}
+
+bool select_focus_provider(const char *name) {
+    close_focus_events();
+
+    if (name && name[0]) {
+        const FocusProvider *requested = find_provider(name);
+        if (!requested) {
+            log_message("Focus: unknown provider '%s'", name);
+        } else if (requested->open()) {
+            provider = requested;
+        }
+    } else {
+        const char *display = getenv("DISPLAY");
+        if (display && display[0] && providers[0].open()) {
+            provider = &providers[0];
+        } else if (providers[1].open()) {
+            provider = &providers[1];
+        }
+    }
+    if (!provider) provider = find_provider("none");
+
+    log_message("Focus: using the %s provider", provider->name);
+    return strcmp(provider->name, "none") != 0;
+}
+
+// Replaces x11 by socket (or none) once its connection is gone, and switches
+// back when the X server can be reached again
+static void check_x11_connection(void) {
+    const FocusProvider *x11 = &providers[0];
+    time_t now = time(NULL);
+    if (provider == x11 && !x_display) {
+        provider = providers[1].open() ? &providers[1] : find_provider("none");
+        x11_retry_at = now + FOCUS_X11_RETRY_SECS;
+        log_message("Focus: using the %s provider until X is back", provider->name);
+    } else if (x11_retry_at && now >= x11_retry_at && provider != x11) {
+        x11_retry_at = now + FOCUS_X11_RETRY_SECS;
+        if (x11->open()) {
+            provider->close();
+            provider = x11;
+            x11_retry_at = 0;
+            log_message("Focus: reconnected to the X server");
+        }
+    }
+}
+
+// Backends are opened on first use so runs that never ask for focus load nothing
+static const FocusProvider *active_provider(void) {
+    if (!provider) select_focus_provider(getenv("ANDROID_SCHED_FOCUS"));
+    check_x11_connection();
+    return provider;
+}
+
+const char *focus_provider_name(void) {
+    return provider ? provider->name : "unselected";
+}
+
+pid_t get_focused_window_pid(void) {
+    return active_provider()->current();
+}
+
+int get_visible_pids(pid_t *pids, int max) {
+    return active_provider()->visible(pids, max);
+}
+
+int open_focus_events(void) {
+    return active_provider()->event_fd();
+}
+
+bool focus_events_pending(void) {
+    return provider && provider->pending();
+}
+
+pid_t poll_focus_event(void) {
+    return provider ? provider->poll_event() : -1;
+}
+
+void close_focus_events(void) {
+    if (provider) {
+        provider->close();
+        provider = NULL;
+    }
+    x11_retry_at = 0;
+}
@@ -0,0 +1,151 @@
+#include "android_scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <dirent.h>
+#include <time.h>
+
+/*
+ * GPU engine-busy sampling from DRM fdinfo
+ *
+ * Holding an open /dev/dri fd says nothing about rendering: every compositor
+ * client has one. Since Linux 5.19 most DRM drivers expose per-client busy
+ * time in /proc/<pid>/fdinfo/<fd>:
+ *
+ *   drm-driver:        i915
+ *   drm-client-id:     7
+ *   drm-engine-render: 1203393201 ns
+ *   drm-engine-video:  0 ns
+ *
+ * A process's DRM fds are found by an fd walk that is cached for
+ * GPU_FD_REFRESH_SECS; each sample then reads only those fdinfo files. Busy
+ * time is summed over engines and distinct clients (dup'd fds share a client
+ * id), and the delta between samples gives the utilisation. Whenever a
+ * rescan changes the fd set the baseline is dropped, since a newly seen fd
+ * brings its whole lifetime's busy time; the next sample starts over.
+ *
+ * Every reader takes a proc root so it can be tested against a fabricated
+ * tree: <root>/<pid>/fd/<n> symlinks plus <root>/<pid>/fdinfo/<n> text files.
+ * The sampler reads /proc unless set_gpu_proc_root() points it elsewhere;
+ * test_gpu.sh drives both.
+ */
+
+static char gpu_proc_root[256] = "/proc";
+
+void set_gpu_proc_root(const char *root) {
+    strncpy(gpu_proc_root, root, sizeof(gpu_proc_root) - 1);
+    gpu_proc_root[sizeof(gpu_proc_root) - 1] = '\0';
+}
+
+static double monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+int scan_drm_fds(const char *proc_root, pid_t pid, int *fds, int max) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%d/fd", proc_root, pid);
+    DIR *dir = opendir(path);
+    if (!dir) return 0;
+
+    int count = 0;
+    struct dirent *entry;
+    char link_path[512], target[512];
+    while ((entry = readdir(dir)) != NULL && count < max) {
+        if (entry->d_name[0] == '.') continue;
+        snprintf(link_path, sizeof(link_path), "%s/%s", path, entry->d_name);
+        ssize_t len = readlink(link_path, target, sizeof(target) - 1);
+        if (len == -1) continue;
+        target[len] = '\0';
+        if (strstr(target, "/dev/dri/") || strstr(target, "/dev/nvidia")) {
+            fds[count++] = atoi(entry->d_name);
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+int read_drm_busy_ns(const char *proc_root, pid_t pid, const int *fds, int count,
+                     unsigned long long *busy_ns) {
+    unsigned long long seen_clients[MAX_DRM_FDS];
+    int client_count = 0;
+    bool have_counters = false;
+    *busy_ns = 0;
+
+    for (int i = 0; i < count; i++) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s/%d/fdinfo/%d", proc_root, pid, fds[i]);
+        FILE *f = fopen(path, "r");
+        if (!f) continue;
+
+        char line[256];
+        unsigned long long client_id = 0, fd_busy = 0;
+        bool has_client = false, fd_counters = false;
+        while (fgets(line, sizeof(line), f)) {
+            unsigned long long value;
+            if (sscanf(line, "drm-client-id: %llu", &value) == 1) {
+                client_id = value;
+                has_client = true;
+            } else if (strncmp(line, "drm-engine-", 11) == 0 && strncmp(line, "drm-engine-capacity-", 20) != 0) {
+                char *colon = strchr(line, ':');
+                if (colon && sscanf(colon + 1, "%llu", &value) == 1) {
+                    fd_busy += value;
+                    fd_counters = true;
+                }
+            }
+        }
+        fclose(f);
+        if (!fd_counters) continue;
+
+        // Duplicated fds report the same client; count each client once
+        bool duplicate = false;
+        for (int j = 0; j < client_count && has_client; j++) {
+            if (seen_clients[j] == client_id) duplicate = true;
+        }
+        if (duplicate) continue;
+        if (has_client && client_count < MAX_DRM_FDS) seen_clients[client_count++] = client_id;
+
+        *busy_ns += fd_busy;
+        have_counters = true;
+    }
+    return have_counters ? 0 : -1;
+}
+
+float sample_gpu_utilization(TrackedProcess *proc, time_t now) {
+    // Over the overhead budget the fd list is not re-walked; known fds are still read
+    bool rescan = proc->drm_fds_checked_at == 0 || now - proc->drm_fds_checked_at >= GPU_FD_REFRESH_SECS;
+    if (rescan && !overhead_shed_probes()) {
+        int fds[MAX_DRM_FDS];
+        int count = scan_drm_fds(gpu_proc_root, proc->pid, fds, MAX_DRM_FDS);
+        if (count != proc->drm_fd_count || memcmp(fds, proc->drm_fds, count * sizeof(int)) != 0) {
+            memcpy(proc->drm_fds, fds, count * sizeof(int));
+            proc->drm_fd_count = count;
+            proc->gpu_busy_ns = 0;
+            proc->gpu_sampled_at_ms = 0;
+        }
+        proc->drm_fds_checked_at = now;
+    }
+    if (proc->drm_fd_count == 0) {
+        proc->gpu_percent = 0;
+        return 0;
+    }
+
+    unsigned long long busy_ns;
+    if (read_drm_busy_ns(gpu_proc_root, proc->pid, proc->drm_fds, proc->drm_fd_count, &busy_ns) != 0) {
+        return -1;  // Driver without fdinfo counters
+    }
+
+    double sampled_ms = monotonic_ms();
+    float percent = 0;
+    if (proc->gpu_sampled_at_ms > 0 && busy_ns >= proc->gpu_busy_ns) {
+        double window_ms = sampled_ms - proc->gpu_sampled_at_ms;
+        if (window_ms > 0) percent = (float)(100.0 * (busy_ns - proc->gpu_busy_ns) / 1e6 / window_ms);
+        if (percent > 100) percent = 100;    // Engines are summed
+    }
+    proc->gpu_busy_ns = busy_ns;
+    proc->gpu_sampled_at_ms = sampled_ms;
+    proc->gpu_percent = percent;
+    return percent;
+}
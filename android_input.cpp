@@ -0,0 +1,373 @@
+#include "android_scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/inotify.h>
+#include <linux/input.h>
+
+/*
+ * Input- and focus-driven interaction boost
+ *
+ * Every /dev/input/event* device a user interacts with is opened non-blocking
+ * and watched from the monitor's wait loop: keyboards, buttons (mice, pads,
+ * tablets, touch), relative pointers and absolute pointers that also report
+ * a button or multitouch contacts. Accelerometers (INPUT_PROP_ACCELEROMETER
+ * or bare ABS axes), lid and power switches and other sensors stream or fire
+ * without the user touching anything, so they are skipped; one of them would
+ * otherwise hold the boost on permanently. Event payloads are drained but
+ * never inspected; only the kernel timestamp is used, switched to
+ * CLOCK_MONOTONIC so it can be compared with our own clock to measure
+ * input-to-boost latency. /dev/input
+ * is watched with inotify so devices plugged in later are opened too, and a
+ * device that hangs up (POLLHUP/POLLERR, or ENODEV on read) is closed and
+ * dropped, so an unplugged device does not keep poll() returning at once.
+ *
+ * Any input raises cpu.weight on the foreground tier to INPUT_BOOST_CPU_WEIGHT.
+ * Each further event extends the window, and the boost decays
+ * input_boost_ms after the last event. The regular cycle writes cpu.weight
+ * only on the per-app cgroups below the tier, so it does not undo the boost.
+ *
+ * Where the kernel has cgroup uclamp, a boost also sets the foreground tier's
+ * cpu.uclamp.min to UCLAMP_BOOST_MIN. schedutil then raises the frequency
+ * for the foreground app straight away instead of waiting for its load
+ * average to build up. A focus change starts the same boost as input. When
+ * the window ends, cpu.weight returns to the default at once, but
+ * uclamp.min is halved every UCLAMP_DECAY_STEP_MS until it reaches zero.
+ * The cached tier is permanently capped by cpu.uclamp.max.
+ *
+ * A child cgroup's effective uclamp.min is the smaller of its own request and
+ * its parent's, and a new cgroup requests 0. So every app cgroup in the
+ * foreground tier (and its launch cgroup) requests "max", which leaves the
+ * tier value as the single knob. uclamp.max needs no such step because the
+ * children default to "max". Both tier values are reset at shutdown.
+ */
+
+static int input_fds[MAX_INPUT_DEVICES];
+static char input_names[MAX_INPUT_DEVICES][16];   // eventN, to skip devices already open
+static int input_fd_count = 0;
+static int inotify_fd = -1;
+static int input_boost_ms = INPUT_BOOST_MS;
+static double boost_deadline_ms = 0;      // CLOCK_MONOTONIC, 0 = not boosted
+static int uclamp_min = 0;                // Foreground cpu.uclamp.min last written, %
+static double decay_at_ms = 0;            // Next uclamp.min decay step, 0 = not decaying
+static pid_t last_focus_pid = 0;
+
+// Latency statistics
+static unsigned long boosts = 0;
+static unsigned long focus_boosts = 0;
+static unsigned long input_batches = 0;
+static double latency_total_ms = 0;
+static double latency_max_ms = 0;
+
+static double monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+#define BITS_PER_LONG (8 * sizeof(unsigned long))
+#define BIT_WORDS(max) ((max) / BITS_PER_LONG + 1)
+
+static bool test_bit(const unsigned long *bits, int bit) {
+    return (bits[bit / BITS_PER_LONG] >> (bit % BITS_PER_LONG)) & 1;
+}
+
+static bool any_bit(const unsigned long *bits, int first, int last) {
+    for (int bit = first; bit <= last; bit++) {
+        if (test_bit(bits, bit)) return true;
+    }
+    return false;
+}
+
+// True for keyboards, buttons and pointers; false for sensors and switches
+static bool is_interactive_device(int fd) {
+    unsigned long props[BIT_WORDS(INPUT_PROP_MAX)] = { 0 };
+    unsigned long types[BIT_WORDS(EV_MAX)] = { 0 };
+    unsigned long keys[BIT_WORDS(KEY_MAX)] = { 0 };
+    unsigned long rel[BIT_WORDS(REL_MAX)] = { 0 };
+    unsigned long axes[BIT_WORDS(ABS_MAX)] = { 0 };
+
+    if (ioctl(fd, EVIOCGPROP(sizeof(props)), props) >= 0 && test_bit(props, INPUT_PROP_ACCELEROMETER)) return false;
+    if (ioctl(fd, EVIOCGBIT(0, sizeof(types)), types) < 0) return false;
+
+    bool keyboard = false, buttons = false;
+    if (test_bit(types, EV_KEY) && ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys) >= 0) {
+        keyboard = any_bit(keys, KEY_ESC, KEY_KPDOT);    // The main block, not power or media keys
+        buttons = any_bit(keys, BTN_MISC, BTN_GEAR_UP);  // Mouse, joystick, gamepad, touch, stylus
+    }
+    if (keyboard || buttons) return true;
+
+    if (test_bit(types, EV_REL) && ioctl(fd, EVIOCGBIT(EV_REL, sizeof(rel)), rel) >= 0 &&
+        test_bit(rel, REL_X) && test_bit(rel, REL_Y)) {
+        return true;
+    }
+    // Bare ABS_X/ABS_Y is also how older accelerometer drivers look
+    if (test_bit(types, EV_ABS) && ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(axes)), axes) >= 0 &&
+        test_bit(axes, ABS_MT_POSITION_X)) {
+        return true;
+    }
+    return false;
+}
+
+// Opens /dev/input/<name> if it is an interactive event device not already open
+static bool open_input_device(const char *name) {
+    if (strncmp(name, "event", 5) != 0 || strlen(name) >= sizeof(input_names[0])) return false;
+    if (input_fd_count >= MAX_INPUT_DEVICES) return false;
+    for (int i = 0; i < input_fd_count; i++) {
+        if (strcmp(input_names[i], name) == 0) return false;
+    }
+
+    char path[300];
+    snprintf(path, sizeof(path), "/dev/input/%s", name);
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd == -1) return false;
+    if (!is_interactive_device(fd)) {
+        close(fd);
+        return false;
+    }
+
+    int clock = CLOCK_MONOTONIC;
+    ioctl(fd, EVIOCSCLOCKID, &clock);
+    strcpy(input_names[input_fd_count], name);
+    input_fds[input_fd_count++] = fd;
+    return true;
+}
+
+static void drop_input_device(int index) {
+    log_message("Input device %s gone, no longer watched", input_names[index]);
+    close(input_fds[index]);
+    input_fd_count--;
+    input_fds[index] = input_fds[input_fd_count];
+    strcpy(input_names[index], input_names[input_fd_count]);
+}
+
+int open_input_devices(void) {
+    const char *window = getenv("ANDROID_SCHED_INPUT_BOOST_MS");
+    if (window && atoi(window) > 0) input_boost_ms = atoi(window);
+
+    // Watch first so a device created during the scan is not missed. udev
+    // creates the node before fixing its permissions, hence IN_ATTRIB
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd != -1 && inotify_add_watch(inotify_fd, "/dev/input", IN_CREATE | IN_ATTRIB) == -1) {
+        close(inotify_fd);
+        inotify_fd = -1;
+    }
+
+    DIR *dir = opendir("/dev/input");
+    if (!dir) {
+        log_message("Input boost disabled: /dev/input not available");
+        return 0;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        open_input_device(entry->d_name);
+    }
+    closedir(dir);
+
+    log_message("Input boost watching %d devices (window %d ms)%s", input_fd_count, input_boost_ms,
+                inotify_fd != -1 ? ", hotplug via inotify" : "");
+    return input_fd_count;
+}
+
+void close_input_devices(void) {
+    for (int i = 0; i < input_fd_count; i++) {
+        close(input_fds[i]);
+    }
+    input_fd_count = 0;
+    if (inotify_fd != -1) {
+        close(inotify_fd);
+        inotify_fd = -1;
+    }
+}
+
+// The inotify fd, if any, comes first, then one entry per device in order
+int input_fill_pollfds(struct pollfd *fds, int max) {
+    int n = 0;
+    if (inotify_fd != -1 && n < max) {
+        fds[n].fd = inotify_fd;
+        fds[n].events = POLLIN;
+        fds[n].revents = 0;
+        n++;
+    }
+    for (int i = 0; i < input_fd_count && n < max; i++) {
+        fds[n].fd = input_fds[i];
+        fds[n].events = POLLIN;
+        fds[n].revents = 0;
+        n++;
+    }
+    return n;
+}
+
+bool input_boost_active(void) {
+    return boost_deadline_ms > 0;
+}
+
+// Time until the boost window ends or the next decay step, -1 if neither is pending
+int input_boost_remaining_ms(void) {
+    double next = (boost_deadline_ms > 0) ? boost_deadline_ms : decay_at_ms;
+    if (next == 0) return -1;
+    double left = next - monotonic_ms();
+    return left > 0 ? (int)left + 1 : 0;
+}
+
+static void write_uclamp_min(int pct) {
+    if (pct == uclamp_min) return;
+    uclamp_min = pct;
+    if (!cgroup_capable(CGROUP_CAP_UCLAMP)) return;
+
+    char value[16];
+    snprintf(value, sizeof(value), "%d", pct);
+    write_cgroup_file(CGROUP_FOREGROUND, "cpu.uclamp.min", value);
+}
+
+// Lets a foreground app cgroup inherit the tier's uclamp.min
+void init_app_uclamp(const char *cgroup_path) {
+    if (!cgroup_capable(CGROUP_CAP_UCLAMP)) return;
+    size_t len = strlen(CGROUP_FOREGROUND);
+    if (strncmp(cgroup_path, CGROUP_FOREGROUND, len) != 0 || cgroup_path[len] != '/') return;
+    write_cgroup_file(cgroup_path, "cpu.uclamp.min", "max");
+}
+
+void init_uclamp(void) {
+    if (!cgroup_capable(CGROUP_CAP_UCLAMP)) {
+        log_message("uclamp: not available, boosts use cpu.weight only");
+        return;
+    }
+
+    char value[16];
+    snprintf(value, sizeof(value), "%d", UCLAMP_CACHED_MAX);
+    write_cgroup_file(CGROUP_CACHED, "cpu.uclamp.max", value);
+    write_cgroup_file(CGROUP_FOREGROUND, "cpu.uclamp.min", "0");
+    write_cgroup_file(CGROUP_FOREGROUND "/" LAUNCH_CGROUP, "cpu.uclamp.min", "max");
+    uclamp_min = 0;
+    log_message("uclamp: foreground boost %d%%, cached max %d%%", UCLAMP_BOOST_MIN, UCLAMP_CACHED_MAX);
+}
+
+void close_uclamp(void) {
+    if (!cgroup_capable(CGROUP_CAP_UCLAMP)) return;
+    write_cgroup_file(CGROUP_FOREGROUND, "cpu.uclamp.min", "0");
+    write_cgroup_file(CGROUP_CACHED, "cpu.uclamp.max", "max");
+    uclamp_min = 0;
+    boost_deadline_ms = 0;
+    decay_at_ms = 0;
+}
+
+// Starts or extends the boost window; true if it was not already running
+static bool start_boost(double now) {
+    bool was_active = input_boost_active();
+    boost_deadline_ms = now + input_boost_ms;
+    decay_at_ms = 0;
+    write_uclamp_min(UCLAMP_BOOST_MIN);
+
+    if (!was_active && cgroup_capable(CGROUP_CAP_CPU)) {
+        char weight[16];
+        snprintf(weight, sizeof(weight), "%d", INPUT_BOOST_CPU_WEIGHT);
+        write_cgroup_file(CGROUP_FOREGROUND, "cpu.weight", weight);
+    }
+    return !was_active;
+}
+
+void boost_focus_change(pid_t focused_pid) {
+    if (focused_pid <= 0 || focused_pid == last_focus_pid) return;
+    bool first = (last_focus_pid == 0);
+    last_focus_pid = focused_pid;
+
+    // The focus seen at startup is not a change
+    if (first) return;
+    start_boost(monotonic_ms());
+    focus_boosts++;
+}
+
+static void handle_hotplug(void) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    while ((len = read(inotify_fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len; ) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            if (event->len > 0 && open_input_device(event->name)) {
+                log_message("Input device %s added, %d watched", event->name, input_fd_count);
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+void handle_input_ready(struct pollfd *fds, int count) {
+    double latest_event_ms = 0;
+    int first = 0;
+    bool hotplug = false;
+    if (inotify_fd != -1 && count > 0 && fds[0].fd == inotify_fd) {
+        hotplug = (fds[0].revents & POLLIN) != 0;
+        first = 1;
+    }
+
+    // Walk backwards so dropping a device (which moves the last one into its
+    // slot) does not disturb the entries still to be visited
+    for (int i = count - 1; i >= first; i--) {
+        int device = i - first;
+        if (device >= input_fd_count || input_fds[device] != fds[i].fd) continue;
+        if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+            drop_input_device(device);
+            continue;
+        }
+        if (!(fds[i].revents & POLLIN)) continue;
+
+        // Drain the queue; only timestamps are kept
+        struct input_event events[64];
+        ssize_t len;
+        while ((len = read(fds[i].fd, events, sizeof(events))) > 0) {
+            const struct input_event *last = &events[len / sizeof(struct input_event) - 1];
+            double event_ms = last->input_event_sec * 1000.0 + last->input_event_usec / 1000.0;
+            if (event_ms > latest_event_ms) latest_event_ms = event_ms;
+        }
+        if (len == -1 && errno == ENODEV) drop_input_device(device);
+    }
+
+    // After the drops, so a replugged device reusing its name is opened again
+    if (hotplug) handle_hotplug();
+    if (latest_event_ms == 0) return;
+
+    double now = monotonic_ms();
+    if (start_boost(now)) boosts++;
+
+    double latency = now - latest_event_ms;
+    if (latency >= 0) {
+        input_batches++;
+        latency_total_ms += latency;
+        if (latency > latency_max_ms) latency_max_ms = latency;
+    }
+}
+
+void expire_input_boost(void) {
+    double now = monotonic_ms();
+    if (boost_deadline_ms > 0 && now >= boost_deadline_ms) {
+        boost_deadline_ms = 0;
+        decay_at_ms = now;
+
+        // Back to the default tier weight
+        if (cgroup_capable(CGROUP_CAP_CPU)) {
+            write_cgroup_file(CGROUP_FOREGROUND, "cpu.weight", "100");
+        }
+    }
+
+    // Step uclamp.min down so the frequency eases off instead of dropping at once
+    while (decay_at_ms > 0 && now >= decay_at_ms) {
+        int next = uclamp_min / 2;
+        if (next < UCLAMP_DECAY_FLOOR) next = 0;
+        write_uclamp_min(next);
+        decay_at_ms = (next > 0) ? decay_at_ms + UCLAMP_DECAY_STEP_MS : 0;
+    }
+}
+
+void input_report(void) {
+    log_message("Input boost: %lu input boosts, %lu focus boosts, input-to-boost latency %.2f ms avg, %.2f ms max",
+                boosts, focus_boosts, input_batches ? latency_total_ms / input_batches : 0.0, latency_max_ms);
+}
@@ -0,0 +1,158 @@
+#include "android_scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/prctl.h>
+
+#ifndef PR_SET_MEMORY_MERGE
+#define PR_SET_MEMORY_MERGE 67
+#endif
+
+/*
+ * KSM page merging for cached apps
+ *
+ * Cached processes are often instances of the same runtime (Electron, a JVM)
+ * with largely identical heaps. KSM merges those pages without killing
+ * anything. Set ANDROID_SCHED_KSM=1 to enable it.
+ *
+ * The kernel only lets a process opt itself in: PR_SET_MEMORY_MERGE affects
+ * the caller's own mm, and process_madvise() does not accept MADV_MERGEABLE.
+ * So processes we launch opt in between fork and exec (the flag survives exec
+ * from Linux 6.7), and processes started elsewhere take part if they opted in
+ * themselves, e.g. through systemd's MemoryKSM=. Eligibility is read back from
+ * /proc/<pid>/ksm_stat.
+ *
+ * Opted-in processes cannot be switched off one by one from outside, so the
+ * tier policy drives the ksmd scanner instead: it runs while any eligible
+ * process is cached and is paused (run=0, which keeps merged pages) once
+ * none are, e.g. after the last one is promoted. The original run setting
+ * is restored at shutdown.
+ */
+
+#define KSM_RUN_PATH "/sys/kernel/mm/ksm/run"
+
+typedef struct {
+    long merging_pages;
+    long profit;                 // ksm_process_profit, bytes (may be negative)
+    bool merge_any;
+    bool valid;
+} KsmStat;
+
+static bool ksm_enabled = false;
+static int ksm_run_initial = -1;
+static int ksm_run = -1;
+
+static int read_ksm_run(void) {
+    char buf[16];
+    int fd = open(KSM_RUN_PATH, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return -1;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) return -1;
+    buf[n] = '\0';
+    return atoi(buf);
+}
+
+static void write_ksm_run(int run) {
+    char value[8];
+    snprintf(value, sizeof(value), "%d", run);
+    int fd = open(KSM_RUN_PATH, O_WRONLY | O_CLOEXEC);
+    if (fd == -1 || write(fd, value, strlen(value)) < 0) {
+        log_message("KSM: failed to set run=%d: %s", run, strerror(errno));
+    } else {
+        ksm_run = run;
+    }
+    if (fd != -1) close(fd);
+}
+
+static bool read_ksm_stat(pid_t pid, KsmStat *stat) {
+    char path[64], line[128];
+    memset(stat, 0, sizeof(*stat));
+    snprintf(path, sizeof(path), "/proc/%d/ksm_stat", pid);
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+
+    char flag[8];
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "ksm_merging_pages %ld", &stat->merging_pages) == 1) continue;
+        if (sscanf(line, "ksm_process_profit %ld", &stat->profit) == 1) continue;
+        if (sscanf(line, "ksm_merge_any: %7s", flag) == 1) stat->merge_any = (strcmp(flag, "yes") == 0);
+    }
+    fclose(f);
+    stat->valid = true;
+    return true;
+}
+
+void setup_ksm(void) {
+    const char *env = getenv("ANDROID_SCHED_KSM");
+    if (!env || strcmp(env, "1") != 0) return;
+
+    ksm_run_initial = read_ksm_run();
+    if (ksm_run_initial < 0) {
+        log_message("KSM: %s not available, page merging disabled", KSM_RUN_PATH);
+        return;
+    }
+    ksm_run = ksm_run_initial;
+    ksm_enabled = true;
+    log_message("KSM: merging enabled for launched apps, ksmd runs while an eligible app is cached");
+}
+
+// Called in a launched child before exec; must stay async-signal-safe
+void ksm_opt_in_child(void) {
+    if (ksm_enabled) prctl(PR_SET_MEMORY_MERGE, 1, 0, 0, 0);
+}
+
+void update_ksm(void) {
+    if (!ksm_enabled) return;
+
+    int cached_eligible = 0;
+    for (int i = 0; i < process_count; i++) {
+        TrackedProcess *proc = &processes[i];
+        if (proc->state != PROCESS_STATE_CACHED) continue;
+
+        // Eligibility does not change after exec, so one read per process is enough
+        if (!proc->ksm_checked) {
+            KsmStat stat;
+            proc->ksm_merge_any = read_ksm_stat(proc->pid, &stat) && stat.merge_any;
+            proc->ksm_checked = true;
+        }
+        if (proc->ksm_merge_any) cached_eligible++;
+    }
+
+    // 2 (unmerge everything) is left alone, that is an explicit admin request
+    if (ksm_run == 2) return;
+    int run = cached_eligible > 0 ? 1 : 0;
+    if (run != ksm_run) {
+        write_ksm_run(run);
+        log_message("KSM: %s ksmd (%d eligible cached processes)", run ? "started" : "paused", cached_eligible);
+    }
+}
+
+void close_ksm(void) {
+    if (!ksm_enabled) return;
+    if (ksm_run != ksm_run_initial) write_ksm_run(ksm_run_initial);
+    ksm_enabled = false;
+}
+
+void ksm_report(void) {
+    if (!ksm_enabled) return;
+
+    long page_kb = sysconf(_SC_PAGESIZE) / 1024;
+    long total_pages = 0, total_profit = 0;
+    int eligible = 0;
+    for (int i = 0; i < process_count; i++) {
+        KsmStat stat;
+        if (!read_ksm_stat(processes[i].pid, &stat) || !stat.merge_any) continue;
+        eligible++;
+        total_pages += stat.merging_pages;
+        total_profit += stat.profit;
+        log_message("KSM: [%s] PID %d (%s): %ld merged pages (%ldKB), profit %ldKB",
+                    processes[i].name, processes[i].pid, get_state_name(processes[i].state),
+                    stat.merging_pages, stat.merging_pages * page_kb, stat.profit / 1024);
+    }
+    log_message("KSM: ksmd run=%d, %d eligible processes, %ld merged pages (%ldMB), profit %ldMB",
+                ksm_run, eligible, total_pages, total_pages * page_kb / 1024, total_profit / (1024 * 1024));
+}
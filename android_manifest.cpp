@@ -0,0 +1,339 @@
+#include "android_scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+
+/*
+ * Manifest-driven session launch
+ *
+ * A manifest lists the apps and services to bring up, one per line:
+ *
+ *   <name> [tier=<tier>] [priority=<n>] [memory_max=<bytes>] [cpu_weight=<n>]
+ *          [delay=<ms>] [after=<name>] -- <program> [args...]
+ *
+ *   tier:       foreground, visible, service, background or cached (default background)
+ *   priority:   requested priority, -20 (most important) to 20
+ *   memory_max: memory.max cap in bytes (K/M/G suffixes accepted)
+ *   cpu_weight: cpu.weight override (1-10000)
+ *   delay:      start offset in ms (0 to MANIFEST_MAX_DELAY_MS), relative to
+ *               the manifest start or to the launch of the 'after' entry
+ *   after:      name of an entry that must be running first
+ *
+ * Blank lines and lines starting with '#' are ignored. Arguments are split on
+ * whitespace; quoting is not supported. A malformed or out-of-range value,
+ * more than MANIFEST_MAX_ARGS arguments, a duplicate name or more than
+ * MANIFEST_MAX_ENTRIES entries rejects the whole manifest with the offending
+ * line number.
+ *
+ * Example:
+ *   pipewire  tier=service                       -- /usr/bin/pipewire
+ *   panel     tier=visible after=pipewire        -- /usr/bin/waybar
+ *   browser   tier=foreground delay=200 priority=-10 -- firefox
+ *   indexer   tier=background memory_max=512M delay=5000 -- tracker-miner-fs-3
+ *
+ * Entries without dependencies start immediately; each spawn only waits for
+ * the child's exec, so the apps come up concurrently. SIGTERM or SIGINT stops
+ * the launch between entries; what is already running is handed to the
+ * monitor's normal shutdown. The launch fails (non-zero) when no entry ends
+ * up running.
+ */
+
+#define MANIFEST_MAX_DELAY_MS (24 * 60 * 60 * 1000)
+
+typedef struct {
+    char name[64];
+    char tier[32];
+    int priority;
+    long memory_max;
+    int cpu_weight;
+    int delay_ms;
+    char after[64];
+    int after_index;             // Resolved 'after' entry, -1 for none
+    int line_no;
+    char line[1024];             // Owns the argv strings
+    char *argv[MANIFEST_MAX_ARGS + 1];
+    pid_t pid;
+    bool done;                   // Launched or given up on
+    double launched_at_ms;       // Relative to the manifest start
+    double time_to_running_ms;   // From due time until exec succeeded
+} ManifestEntry;
+
+static double elapsed_ms_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// Whole-string decimal in [min, max]
+static bool parse_int(const char *value, long min, long max, long *out) {
+    char *end;
+    errno = 0;
+    long n = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || errno == ERANGE || n < min || n > max) return false;
+    *out = n;
+    return true;
+}
+
+// Positive byte count with an optional K/M/G suffix; false on garbage or overflow
+static bool parse_size(const char *value, long *out) {
+    char *end;
+    errno = 0;
+    long size = strtol(value, &end, 10);
+    if (end == value || errno == ERANGE || size <= 0) return false;
+
+    long unit = 1;
+    switch (*end) {
+        case 'K': case 'k': unit = 1024L; end++; break;
+        case 'M': case 'm': unit = 1024L * 1024; end++; break;
+        case 'G': case 'g': unit = 1024L * 1024 * 1024; end++; break;
+        default: break;
+    }
+    if (*end != '\0' || size > LONG_MAX / unit) return false;
+    *out = size * unit;
+    return true;
+}
+
+static bool parse_manifest_line(ManifestEntry *entry, const char *text, int line_no) {
+    memset(entry, 0, sizeof(*entry));
+    strncpy(entry->tier, "background", sizeof(entry->tier) - 1);
+    entry->after_index = -1;
+    entry->pid = -1;
+    entry->line_no = line_no;
+    strncpy(entry->line, text, sizeof(entry->line) - 1);
+
+    char *save = NULL;
+    char *token = strtok_r(entry->line, " \t\n", &save);
+    if (!token) return false;
+    strncpy(entry->name, token, sizeof(entry->name) - 1);
+
+    // Options up to the "--" separator
+    while ((token = strtok_r(NULL, " \t\n", &save)) != NULL && strcmp(token, "--") != 0) {
+        char *value = strchr(token, '=');
+        if (!value) {
+            log_message("Manifest line %d: expected key=value, got '%s'", line_no, token);
+            return false;
+        }
+        *value++ = '\0';
+
+        long number;
+        if (strcmp(token, "tier") == 0) {
+            strncpy(entry->tier, value, sizeof(entry->tier) - 1);
+        } else if (strcmp(token, "priority") == 0) {
+            if (!parse_int(value, -20, 20, &number)) {
+                log_message("Manifest line %d: priority '%s' is not a number from -20 to 20", line_no, value);
+                return false;
+            }
+            entry->priority = (int)number;
+        } else if (strcmp(token, "memory_max") == 0) {
+            if (!parse_size(value, &entry->memory_max)) {
+                log_message("Manifest line %d: memory_max '%s' is not a positive size (K/M/G suffix)",
+                            line_no, value);
+                return false;
+            }
+        } else if (strcmp(token, "cpu_weight") == 0) {
+            if (!parse_int(value, 1, 10000, &number)) {
+                log_message("Manifest line %d: cpu_weight '%s' is not a number from 1 to 10000", line_no, value);
+                return false;
+            }
+            entry->cpu_weight = (int)number;
+        } else if (strcmp(token, "delay") == 0) {
+            if (!parse_int(value, 0, MANIFEST_MAX_DELAY_MS, &number)) {
+                log_message("Manifest line %d: delay '%s' is not a number of ms from 0 to %d",
+                            line_no, value, MANIFEST_MAX_DELAY_MS);
+                return false;
+            }
+            entry->delay_ms = (int)number;
+        } else if (strcmp(token, "after") == 0) {
+            strncpy(entry->after, value, sizeof(entry->after) - 1);
+        } else {
+            log_message("Manifest line %d: unknown option '%s'", line_no, token);
+            return false;
+        }
+    }
+
+    // Remaining tokens form the command
+    int argc = 0;
+    while ((token = strtok_r(NULL, " \t\n", &save)) != NULL) {
+        if (argc == MANIFEST_MAX_ARGS) {
+            log_message("Manifest line %d: '%s' has more than %d arguments", line_no, entry->name, MANIFEST_MAX_ARGS);
+            return false;
+        }
+        entry->argv[argc++] = token;
+    }
+    entry->argv[argc] = NULL;
+
+    ProcessState state;
+    if (argc == 0) {
+        log_message("Manifest line %d: no command for '%s'", line_no, entry->name);
+        return false;
+    }
+    if (!parse_state_name(entry->tier, &state)) {
+        log_message("Manifest line %d: invalid tier '%s'", line_no, entry->tier);
+        return false;
+    }
+    return true;
+}
+
+static int resolve_dependencies(ManifestEntry *entries, int count) {
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < i; j++) {
+            if (strcmp(entries[j].name, entries[i].name) == 0) {
+                log_message("Manifest line %d: duplicate entry '%s' (first on line %d)",
+                            entries[i].line_no, entries[i].name, entries[j].line_no);
+                return -1;
+            }
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (entries[i].after[0] == '\0') continue;
+        for (int j = 0; j < count; j++) {
+            if (strcmp(entries[j].name, entries[i].after) == 0) {
+                entries[i].after_index = j;
+                break;
+            }
+        }
+        if (entries[i].after_index == -1) {
+            log_message("Manifest: '%s' depends on unknown entry '%s'", entries[i].name, entries[i].after);
+            return -1;
+        }
+    }
+
+    // A chain longer than the entry count can only be a cycle
+    for (int i = 0; i < count; i++) {
+        int steps = 0;
+        for (int j = entries[i].after_index; j != -1; j = entries[j].after_index) {
+            if (++steps > count) {
+                log_message("Manifest: dependency cycle involving '%s'", entries[i].name);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int launch_manifest(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        log_message("Failed to open manifest %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    static ManifestEntry entries[MANIFEST_MAX_ENTRIES];
+    int count = 0;
+    int line_no = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        line_no++;
+        char *text = line + strspn(line, " \t");
+        if (*text == '#' || *text == '\n' || *text == '\0') continue;
+
+        if (count == MANIFEST_MAX_ENTRIES) {
+            log_message("Manifest line %d: more than %d entries", line_no, MANIFEST_MAX_ENTRIES);
+            fclose(f);
+            return -1;
+        }
+        if (!parse_manifest_line(&entries[count], text, line_no)) {
+            fclose(f);
+            return -1;
+        }
+        count++;
+    }
+    fclose(f);
+
+    if (count == 0) {
+        log_message("Manifest %s has no entries", path);
+        return -1;
+    }
+    if (resolve_dependencies(entries, count) != 0) {
+        return -1;
+    }
+
+    log_message("Launching %d entries from manifest %s", count, path);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int remaining = count;
+
+    while (remaining > 0 && !shutdown_requested()) {
+        double now = elapsed_ms_since(&start);
+        double next_due = -1;
+
+        for (int i = 0; i < count && !shutdown_requested(); i++) {
+            ManifestEntry *entry = &entries[i];
+            if (entry->done) continue;
+
+            // Wait for the dependency; a failed dependency fails its dependents
+            double base = 0;
+            if (entry->after_index != -1) {
+                ManifestEntry *dep = &entries[entry->after_index];
+                if (!dep->done) continue;
+                if (dep->pid == -1) {
+                    log_message("Manifest: skipping '%s', dependency '%s' failed", entry->name, dep->name);
+                    entry->done = true;
+                    remaining--;
+                    continue;
+                }
+                base = dep->launched_at_ms;
+            }
+
+            double due = base + entry->delay_ms;
+            if (now < due) {
+                if (next_due < 0 || due < next_due) next_due = due;
+                continue;
+            }
+
+            entry->pid = launch_and_track_process(entry->tier, entry->argv);
+            entry->launched_at_ms = elapsed_ms_since(&start);
+            entry->time_to_running_ms = entry->launched_at_ms - due;
+            entry->done = true;
+            remaining--;
+            now = entry->launched_at_ms;
+
+            if (entry->pid != -1) {
+                TrackedProcess *proc = &processes[process_count - 1];
+                proc->memory_limit = entry->memory_max;
+                proc->cpu_weight = entry->cpu_weight;
+                // Blended into the score from the first cycle on; the initial tier stands until then
+                proc->requested_priority = entry->priority;
+            }
+        }
+
+        // Sleep until the next staggered start (a signal cuts it short);
+        // dependents are picked up on the next pass
+        if (next_due > now && !shutdown_requested()) {
+            double wait_ms = next_due - now;
+            struct timespec ts;
+            ts.tv_sec = (time_t)(wait_ms / 1000);
+            ts.tv_nsec = (long)((wait_ms - ts.tv_sec * 1000.0) * 1e6);
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    if (remaining > 0) {
+        log_message("Manifest: shutdown requested, %d entries not launched", remaining);
+    }
+
+    log_message("Manifest launch summary:");
+    log_message("  %-16s %-8s %-11s %10s %12s", "NAME", "PID", "TIER", "START(ms)", "TO-RUN(ms)");
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        if (!entries[i].done) {
+            log_message("  %-16s %-8s %-11s %10s %12s", entries[i].name, "-", entries[i].tier, "-", "not started");
+            failed++;
+        } else if (entries[i].pid == -1) {
+            log_message("  %-16s %-8s %-11s %10s %12s", entries[i].name, "-", entries[i].tier, "-", "failed");
+            failed++;
+        } else {
+            log_message("  %-16s %-8d %-11s %10.1f %12.2f", entries[i].name, entries[i].pid, entries[i].tier,
+                        entries[i].launched_at_ms, entries[i].time_to_running_ms);
+        }
+    }
+    log_message("Manifest: %d of %d entries running", count - failed, count);
+    return failed == count ? -1 : 0;
+}
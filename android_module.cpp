@@ -10,21 +10,27 @@
 #include <time.h>
 #include <dirent.h>
 #include <stdbool.h>
-#include <sys/sysinfo.h>
 #include <math.h>
 #include <stdarg.h>
 #include <sys/stat.h>
 #include <signal.h>
-#include <X11/Xlib.h>
-#include <X11/Xatom.h>
-#include <X11/Xutil.h>
+#include <pthread.h>
+#include <fnmatch.h>
+#include <glob.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/syscall.h>
 
 /*
  * Android Process Scheduler
  * A simplified implementation of Android-style process management
  * 
  * Usage:
- *   ./android_scheduler [foreground|background] program [args...]
+ *   ./android_scheduler [foreground|visible|service|background|cached] program [args...]
+ *   ./android_scheduler manifest <file>   (launch a set of apps, see android_manifest.cpp)
+ *   ./android_scheduler record <trace> [...]  (any of the above, recording policy inputs)
+ *   ./android_scheduler replay <trace>    (re-run a recorded trace offline, see android_trace.cpp)
+ *   ./android_scheduler bench [cycles]    (replay a synthetic trace and report throughput)
  *   ./android_scheduler (with no arguments to monitor existing processes)
  * 
  * Examples:
@@ -42,14 +48,17 @@
  * Control:
  *   - SIGUSR1: Prints debug information about tracked processes
  *   - SIGTERM/SIGINT: Cleans up and exits
+ *   - SIGUSR2: Saves state and exits, leaving cgroup placements for the next instance
  */
 
-// Global variables
+// Global variables (shared with the other android_* modules via android_scheduler.h)
 TrackedProcess processes[MAX_PROCESSES];
 int process_count = 0;
 int priority_request_fd = -1;
 bool memory_pressure = false;
-static bool should_exit = false;  // Flag to control the main loop
+static volatile sig_atomic_t should_exit = false;  // Flag to control the main loop
+static volatile sig_atomic_t handover_requested = false;  // Exit without touching placements
+static volatile sig_atomic_t report_requested = false;  // SIGUSR1, printed by the wait loop
 
 // Utility functions
 void log_message(const char *format, ...) {
@@ -65,6 +74,17 @@ void log_message(const char *format, ...) {
 }
 
 // Function implementations
+int write_cgroup_file(const char *cgroup_path, const char *file, const char *value) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", cgroup_path, file);
+    
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd == -1) return -1;
+    ssize_t written = write(fd, value, strlen(value));
+    close(fd);
+    return (written < 0) ? -1 : 0;
+}
+
 int assign_to_cgroup(const char *cgroup_path, pid_t pid) {
     char procs_path[256];
     snprintf(procs_path, sizeof(procs_path), "%s/cgroup.procs", cgroup_path);
@@ -120,7 +140,51 @@ long get_process_memory_usage(pid_t pid) {
     return rss;
 }
 
-void update_resource_history(TrackedProcess *proc) {
+int read_smaps_rollup(pid_t pid, long *pss_kb, long *swap_kb) {
+    char path[256];
+    snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", pid);
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -1;
+    
+    char line[256];
+    long swap = 0, swap_pss = -1;
+    *pss_kb = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, "Pss:", 4) == 0) {
+            sscanf(line, "Pss: %ld", pss_kb);
+        } else if (strncmp(line, "Swap:", 5) == 0) {
+            sscanf(line, "Swap: %ld", &swap);
+        } else if (strncmp(line, "SwapPss:", 8) == 0) {
+            sscanf(line, "SwapPss: %ld", &swap_pss);
+        }
+    }
+    fclose(fp);
+    
+    // SwapPss splits shared swapped pages the same way Pss does (kernel 4.16+)
+    *swap_kb = (swap_pss >= 0) ? swap_pss : swap;
+    return 0;
+}
+
+long get_process_footprint(TrackedProcess *proc, time_t now) {
+    // Over the overhead budget, keep the last PSS (or RSS if there is none)
+    if (overhead_shed_probes()) {
+        return proc->pss_sampled_at ? proc->pss_kb : calculate_average_memory(proc);
+    }
+    
+    // smaps_rollup walks every VMA, so it is refreshed at a reduced rate
+    if (proc->pss_sampled_at == 0 || now - proc->pss_sampled_at >= PSS_REFRESH_SECS) {
+        if (read_smaps_rollup(proc->pid, &proc->pss_kb, &proc->swap_kb) == 0) {
+            proc->pss_sampled_at = now;
+        } else if (proc->pss_sampled_at == 0) {
+            // No smaps_rollup (old kernel or permission): fall back to RSS
+            return calculate_average_memory(proc);
+        }
+    }
+    return proc->pss_kb;
+}
+
+// now is the cycle's clock, so activity stamps match what the trace records
+void update_resource_history(TrackedProcess *proc, time_t now) {
     // Update CPU history
     float cpu = get_process_cpu_usage(proc->pid);
     proc->resource_history.cpu_usage[proc->resource_history.cpu_index] = cpu;
@@ -131,20 +195,22 @@ void update_resource_history(TrackedProcess *proc) {
     proc->resource_history.memory_usage[proc->resource_history.mem_index] = mem;
     proc->resource_history.mem_index = (proc->resource_history.mem_index + 1) % MEM_HISTORY_SIZE;
     
-    // Check for network activity
-    if (is_using_network(proc->pid)) {
-        proc->resource_history.last_network_activity = time(NULL);
+    // Check for network activity (skipped over the overhead budget)
+    if (!overhead_shed_probes() && is_using_network(proc->pid)) {
+        proc->resource_history.last_network_activity = now;
     }
     
-    // Update audio status
+    // Update audio status from the per-cycle /proc/asound scan
     proc->is_playing_audio = is_playing_audio(proc->pid);
     if (proc->is_playing_audio) {
-        proc->last_active = time(NULL);
+        proc->last_active = now;
     }
     
-    // Update GPU activity
-    if (is_using_gpu(proc->pid)) {
-        proc->resource_history.last_gpu_activity = time(NULL);
+    // Update GPU activity: only actual rendering counts, unless the driver has no
+    // fdinfo counters, where an open DRM fd is all we can go on
+    float gpu = sample_gpu_utilization(proc, now);
+    if (gpu >= GPU_BUSY_PERCENT || (gpu < 0 && proc->drm_fd_count > 0)) {
+        proc->resource_history.last_gpu_activity = now;
     }
 }
 
@@ -164,105 +230,6 @@ long calculate_average_memory(TrackedProcess *proc) {
     return total / MEM_HISTORY_SIZE;
 }
 
-pid_t get_focused_window_pid(void) {
-    Display *display = XOpenDisplay(NULL);
-    if (!display) {
-        log_message("ERROR: Could not open X display");
-        return -1;
-    }
-
-    Window root = DefaultRootWindow(display);
-    Window focused = None;
-    int revert_to;
-    
-    XGetInputFocus(display, &focused, &revert_to);
-    if (focused == None) {
-        log_message("ERROR: Could not get focused window");
-        XCloseDisplay(display);
-        return -1;
-    }
-
-    // Try to find the application window by traversing up
-    Window parent = None;
-    Window root_return;
-    Window *children = NULL;
-    unsigned int nchildren;
-    
-    // First attempt with _NET_WM_PID on the focused window
-    Atom atom = XInternAtom(display, "_NET_WM_PID", True);
-    if (atom != None) {
-        Atom actual_type;
-        int actual_format;
-        unsigned long nitems, bytes_after;
-        unsigned char *prop = NULL;
-
-        if (XGetWindowProperty(display, focused, atom, 0, 1, False, XA_CARDINAL,
-                              &actual_type, &actual_format, &nitems, &bytes_after, &prop) == Success && prop) {
-            pid_t pid = *(pid_t *)prop;
-            XFree(prop);
-            XCloseDisplay(display);
-            return pid;
-        }
-    }
-
-    // If we couldn't get it directly, try traversing up to find an application window
-    Window current = focused;
-    while (current != None && current != root) {
-        Window parent_return;
-        Window *children_return;
-        unsigned int nchildren_return;
-        
-        Status status = XQueryTree(display, current, &root_return, &parent_return, 
-                                  &children_return, &nchildren_return);
-        
-        if (status == 0) {
-            log_message("ERROR: XQueryTree failed");
-            break;
-        }
-        
-        if (children_return)
-            XFree(children_return);
-        
-        // Try to get PID from this window
-        Atom actual_type;
-        int actual_format;
-        unsigned long nitems, bytes_after;
-        unsigned char *prop = NULL;
-        
-        if (XGetWindowProperty(display, current, atom, 0, 1, False, XA_CARDINAL,
-                              &actual_type, &actual_format, &nitems, &bytes_after, &prop) == Success && prop) {
-            pid_t pid = *(pid_t *)prop;
-            XFree(prop);
-            XCloseDisplay(display);
-            return pid;
-        }
-        
-        // Move up to parent
-        current = parent_return;
-    }
-
-    // If all else fails, try to use xdotool
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd), "xdotool getwindowfocus getwindowpid 2>/dev/null");
-    FILE *fp = popen(cmd, "r");
-    if (fp) {
-        char buf[32];
-        if (fgets(buf, sizeof(buf), fp)) {
-            pid_t pid = atoi(buf);
-            if (pid > 0) {
-                pclose(fp);
-                XCloseDisplay(display);
-                return pid;
-            }
-        }
-        pclose(fp);
-    }
-
-    XCloseDisplay(display);
-    log_message("ERROR: Could not determine PID of focused window");
-    return -1;
-}
-
 pid_t get_parent_pid(pid_t pid) {
     char path[256];
     snprintf(path, sizeof(path), "/proc/%d/status", pid);
@@ -278,53 +245,59 @@ pid_t get_parent_pid(pid_t pid) {
     return ppid;
 }
 
-bool is_playing_audio(pid_t pid) {
-    char path[256];
-    snprintf(path, sizeof(path), "/proc/%d/fd", pid);
-    DIR *dir = opendir(path);
-    if (!dir) return false;
+// PCM playback substreams found RUNNING in the last scan_audio_owners().
+// Behind a sound server the owner is the server itself: its clients only hold
+// a socket, and mapping streams back to them means asking the server, which
+// is not a cheap per-cycle pass, so only the server is credited with playback.
+static pid_t audio_owner_pids[MAX_AUDIO_OWNERS];
+static int audio_owner_count = 0;
 
-    struct dirent *entry;
-    char link_path[512], target[512];
-    while ((entry = readdir(dir)) != NULL) {
-        snprintf(link_path, sizeof(link_path), "%s/%s", path, entry->d_name);
-        ssize_t len = readlink(link_path, target, sizeof(target) - 1);
-        if (len != -1) {
-            target[len] = '\0';
-            if (strstr(target, "/snd/") || strstr(target, "/pulse/") || strstr(target, "/alsa/")) {
-                closedir(dir);
-                return true;
+void scan_audio_owners(void) {
+    audio_owner_count = 0;
+    
+    // One pass over the playback substreams replaces a per-process fd walk
+    glob_t streams;
+    if (glob(ASOUND_ROOT "/card*/pcm*p/sub*/status", 0, NULL, &streams) != 0) return;
+    
+    for (size_t i = 0; i < streams.gl_pathc && audio_owner_count < MAX_AUDIO_OWNERS; i++) {
+        FILE *f = fopen(streams.gl_pathv[i], "r");
+        if (!f) continue;
+        
+        char line[128];
+        bool running = false;
+        pid_t owner = -1;
+        while (fgets(line, sizeof(line), f)) {
+            if (strncmp(line, "state:", 6) == 0) {
+                running = strstr(line, "RUNNING") != NULL;
+            } else if (strncmp(line, "owner_pid", 9) == 0) {
+                sscanf(strchr(line, ':') + 1, "%d", &owner);
             }
         }
+        fclose(f);
+        
+        if (running && owner > 0) {
+            audio_owner_pids[audio_owner_count++] = owner;
+        }
     }
-    closedir(dir);
-    return false;
+    globfree(&streams);
 }
 
-bool is_using_gpu(pid_t pid) {
-    char path[256];
-    snprintf(path, sizeof(path), "/proc/%d/fd", pid);
-    DIR *dir = opendir(path);
-    if (!dir) return false;
-
-    struct dirent *entry;
-    char link_path[512], target[512];
-    while ((entry = readdir(dir)) != NULL) {
-        snprintf(link_path, sizeof(link_path), "%s/%s", path, entry->d_name);
-        ssize_t len = readlink(link_path, target, sizeof(target) - 1);
-        if (len != -1) {
-            target[len] = '\0';
-            if (strstr(target, "/dri/") || strstr(target, "/nvidia") || 
-                strstr(target, "/dev/dri/") || strstr(target, "/dev/nvidia")) {
-                closedir(dir);
-                return true;
-            }
-        }
+bool is_audio_owner(pid_t pid) {
+    for (int i = 0; i < audio_owner_count; i++) {
+        if (audio_owner_pids[i] == pid) return true;
     }
-    closedir(dir);
     return false;
 }
 
+bool is_playing_audio(pid_t pid) {
+    return is_audio_owner(pid);
+}
+
+bool is_using_gpu(pid_t pid) {
+    int fds[MAX_DRM_FDS];
+    return scan_drm_fds("/proc", pid, fds, MAX_DRM_FDS) > 0;
+}
+
 bool check_disk_activity(pid_t pid) {
     char path[256];
     snprintf(path, sizeof(path), "/proc/%d/io", pid);
@@ -375,19 +348,132 @@ bool is_using_network(pid_t pid) {
     return false;
 }
 
+// Runs after update_tier_accounting() so the tier events are current
 bool check_memory_pressure(void) {
-    struct sysinfo info;
-    if (sysinfo(&info) != 0) return false;
+    // A tier that hit its memory.high or memory.max is under pressure whatever the system says
+    for (int state = 0; state < PROCESS_STATE_COUNT; state++) {
+        if (tier_under_memory_pressure((ProcessState)state)) return true;
+    }
     
-    // Calculate free memory percentage
-    long total_ram = info.totalram * info.mem_unit;
-    long free_ram = info.freeram * info.mem_unit;
-    long free_percentage = (free_ram * 100) / total_ram;
+    // Otherwise tasks stalling on memory, or little left to allocate. MemAvailable
+    // counts reclaimable page cache, which free RAM does not
+    if (system_memory_stall_pct() >= MEMORY_PRESSURE_PSI_PCT) return true;
+    int available = system_memory_available_pct();
+    return available >= 0 && available < LOW_MEMORY_THRESHOLD;
+}
+
+bool cmdline_is_system_service(const char *cmdline, size_t len) {
+    char buf[256];
+    if (len == 0) return false;
+    if (len > sizeof(buf) - 1) len = sizeof(buf) - 1;
+    memcpy(buf, cmdline, len);
+    buf[len] = '\0';
+    return (strstr(buf, "systemd") || strstr(buf, "dbus") || 
+            strstr(buf, "networkmanager") || strstr(buf, "pulseaudio") ||
+            strstr(buf, "pipewire") || strstr(buf, "Xorg") ||
+            strstr(buf, "cupsd") || strstr(buf, "bluetoothd"));
+}
+
+// Classification rules, first match wins; replaced by SERVICE_RULES_FILE if present
+typedef struct {
+    char pattern[128];
+    CgroupClass cls;
+} ServiceRule;
+
+static ServiceRule service_rules[MAX_SERVICE_RULES] = {
+    {"/init.scope", CGROUP_CLASS_SERVICE},
+    {"/system.slice/*", CGROUP_CLASS_SERVICE},
+    {"/user.slice/*/session.slice/*", CGROUP_CLASS_SERVICE},
+    {"/user.slice/*/app.slice/*", CGROUP_CLASS_APP},
+    {"/user.slice/*.scope", CGROUP_CLASS_APP},
+    {"/user.slice/*", CGROUP_CLASS_APP}
+};
+static int service_rule_count = 6;
+
+void load_service_rules(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        log_message("Using built-in service classification rules (%d rules)", service_rule_count);
+        return;
+    }
+    
+    // Format: one "service <glob>" or "app <glob>" per line, '#' starts a comment
+    ServiceRule loaded[MAX_SERVICE_RULES];
+    int count = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), f) && count < MAX_SERVICE_RULES) {
+        char kind[16], pattern[128];
+        if (line[0] == '#' || sscanf(line, "%15s %127s", kind, pattern) != 2) continue;
+        
+        if (strcmp(kind, "service") == 0) {
+            loaded[count].cls = CGROUP_CLASS_SERVICE;
+        } else if (strcmp(kind, "app") == 0) {
+            loaded[count].cls = CGROUP_CLASS_APP;
+        } else {
+            log_message("Ignoring unknown rule kind '%s' in %s", kind, path);
+            continue;
+        }
+        strncpy(loaded[count].pattern, pattern, sizeof(loaded[count].pattern) - 1);
+        loaded[count].pattern[sizeof(loaded[count].pattern) - 1] = '\0';
+        count++;
+    }
+    fclose(f);
     
-    return (free_percentage < LOW_MEMORY_THRESHOLD);
+    memcpy(service_rules, loaded, count * sizeof(ServiceRule));
+    service_rule_count = count;
+    log_message("Loaded %d service classification rules from %s", count, path);
+}
+
+int read_origin_cgroup(pid_t pid, char *buf, size_t size) {
+    char path[256];
+    snprintf(path, sizeof(path), "/proc/%d/cgroup", pid);
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    
+    // Prefer the unified (v2) entry, fall back to the v1 name=systemd hierarchy
+    char line[512];
+    int found = -1;
+    while (fgets(line, sizeof(line), f)) {
+        char *cgroup;
+        bool unified = (strncmp(line, "0::", 3) == 0);
+        if (unified) {
+            cgroup = line + 3;
+        } else if ((cgroup = strstr(line, ":name=systemd:")) != NULL) {
+            cgroup += 14;
+        } else {
+            continue;
+        }
+        
+        cgroup[strcspn(cgroup, "\n")] = '\0';
+        strncpy(buf, cgroup, size - 1);
+        buf[size - 1] = '\0';
+        found = 0;
+        if (unified) break;
+    }
+    fclose(f);
+    return found;
+}
+
+CgroupClass classify_cgroup_path(const char *cgroup) {
+    if (!cgroup || cgroup[0] == '\0' || strcmp(cgroup, "/") == 0) {
+        return CGROUP_CLASS_UNKNOWN;
+    }
+    for (int i = 0; i < service_rule_count; i++) {
+        if (fnmatch(service_rules[i].pattern, cgroup, 0) == 0) {
+            return service_rules[i].cls;
+        }
+    }
+    return CGROUP_CLASS_UNKNOWN;
 }
 
 bool is_system_service(pid_t pid) {
+    char cgroup[256];
+    if (read_origin_cgroup(pid, cgroup, sizeof(cgroup)) == 0) {
+        CgroupClass cls = classify_cgroup_path(cgroup);
+        if (cls != CGROUP_CLASS_UNKNOWN) return cls == CGROUP_CLASS_SERVICE;
+    }
+    
+    // Hosts without systemd slices fall back to the command line heuristic
     char cmdline[256];
     snprintf(cmdline, sizeof(cmdline), "/proc/%d/cmdline", pid);
     
@@ -398,14 +484,7 @@ bool is_system_service(pid_t pid) {
     size_t len = fread(buf, 1, sizeof(buf) - 1, f);
     fclose(f);
     
-    if (len > 0) {
-        buf[len] = '\0';
-        return (strstr(buf, "systemd") || strstr(buf, "dbus") || 
-                strstr(buf, "networkmanager") || strstr(buf, "pulseaudio") ||
-                strstr(buf, "pipewire") || strstr(buf, "Xorg") ||
-                strstr(buf, "cupsd") || strstr(buf, "bluetoothd"));
-    }
-    return false;
+    return cmdline_is_system_service(buf, len);
 }
 
 void set_oom_score(pid_t pid, int score) {
@@ -419,9 +498,15 @@ void set_oom_score(pid_t pid, int score) {
     }
 }
 
-float calculate_importance_score(TrackedProcess *proc, pid_t focused_pid) {
+float calculate_importance_score(TrackedProcess *proc, pid_t focused_pid, time_t now) {
+    // Refresh the parent link, then score from the process's recorded inputs
+    pid_t parent = get_parent_pid(proc->pid);
+    if (parent > 0) proc->ppid = parent;
+    return calculate_importance_score_at(proc, focused_pid, now);
+}
+
+float calculate_importance_score_at(TrackedProcess *proc, pid_t focused_pid, time_t now) {
     float score = 0.0;
-    time_t now = time(NULL);
     
     // Process state base scores
     if (proc->pid == focused_pid) {
@@ -430,7 +515,7 @@ float calculate_importance_score(TrackedProcess *proc, pid_t focused_pid) {
     }
     
     // Check if child/parent of focused process
-    pid_t parent = get_parent_pid(proc->pid);
+    pid_t parent = proc->ppid;
     if (parent > 0 && parent == focused_pid) {
         score += 90.0;  // Child of focused process
     }
@@ -474,7 +559,11 @@ float calculate_importance_score(TrackedProcess *proc, pid_t focused_pid) {
     // Memory pressure adjustments
     if (memory_pressure) {
         // Under memory pressure, reduce score of high memory users
+        // Kill and limit candidates are judged by PSS + swap; RSS double-counts shared libraries
         long avg_mem = calculate_average_memory(proc);
+        if (proc->state >= PROCESS_STATE_BACKGROUND) {
+            avg_mem = get_process_footprint(proc, now) + proc->swap_kb;
+        }
         if (avg_mem > 500000) {  // More than ~500MB
             score -= 20.0;
         }
@@ -532,6 +621,27 @@ const char* get_cgroup_for_state(ProcessState state) {
     }
 }
 
+const char* get_state_name(ProcessState state) {
+    switch (state) {
+        case PROCESS_STATE_FOREGROUND: return "FOREGROUND";
+        case PROCESS_STATE_VISIBLE: return "VISIBLE";
+        case PROCESS_STATE_SERVICE: return "SERVICE";
+        case PROCESS_STATE_BACKGROUND: return "BACKGROUND";
+        case PROCESS_STATE_CACHED: return "CACHED";
+        default: return "UNKNOWN";
+    }
+}
+
+bool parse_state_name(const char *name, ProcessState *state) {
+    if (strcasecmp(name, "foreground") == 0) *state = PROCESS_STATE_FOREGROUND;
+    else if (strcasecmp(name, "visible") == 0) *state = PROCESS_STATE_VISIBLE;
+    else if (strcasecmp(name, "service") == 0) *state = PROCESS_STATE_SERVICE;
+    else if (strcasecmp(name, "background") == 0) *state = PROCESS_STATE_BACKGROUND;
+    else if (strcasecmp(name, "cached") == 0) *state = PROCESS_STATE_CACHED;
+    else return false;
+    return true;
+}
+
 int get_oom_score_for_state(ProcessState state) {
     switch (state) {
         case PROCESS_STATE_FOREGROUND: return -900;  // Least likely to be killed
@@ -543,58 +653,113 @@ int get_oom_score_for_state(ProcessState state) {
     }
 }
 
-void update_process_state(TrackedProcess *proc, float importance_score) {
+void apply_process_state(TrackedProcess *proc, ProcessState new_state, float importance_score) {
     ProcessState old_state = proc->state;
+    proc->state = new_state;
     
-    if (proc->requested_priority != 0) {
+    // Only log and rescore OOM if state changed
+    if (old_state != proc->state) {
+        log_message("[%s] PID %d State changed : %s -> %s (score: %.1f)", 
+                  proc->name, proc->pid, get_state_name(old_state), get_state_name(proc->state), importance_score);
+        
+        proc->oom_score = get_oom_score_for_state(proc->state);
+        proc->oom_pending = true;
+    }
+    
+    // Keep the process in its app's cgroup under the tier. This migrates it on
+    // a tier change, when it joins another app, and on the first decision
+    char target_cgroup[256], same_app_cgroup[256];
+    pid_t app_id = proc->app_id > 0 ? proc->app_id : proc->pid;
+    app_cgroup_path(proc->state, app_id, target_cgroup, sizeof(target_cgroup));
+    app_cgroup_path(old_state, app_id, same_app_cgroup, sizeof(same_app_cgroup));
+    if (cgroup_capable(CGROUP_CAP_TIERS) && strcmp(proc->cgroup_path, target_cgroup) != 0) {
+        if (enter_app_cgroup(target_cgroup, proc->pid) == 0) {
+            char old_cgroup[256];
+            strcpy(old_cgroup, proc->cgroup_path);
+            strncpy(proc->cgroup_path, target_cgroup, sizeof(proc->cgroup_path)-1);
+            proc->memory_low = 0;  // A new cgroup starts unprotected
+
+            // On a tier change the whole app moves, including untracked children
+            if (strcmp(old_cgroup, same_app_cgroup) == 0) {
+                int moved = migrate_app_cgroup(old_cgroup, target_cgroup);
+                if (moved > 0) log_message("[%s] Moved %d more processes of app %d to %s",
+                                           proc->name, moved, app_id, target_cgroup);
+            }
+            remove_app_cgroup(old_cgroup);
+        } else {
+            log_message("[%s] Failed to assign to cgroup %s", proc->name, target_cgroup);
+        }
+    }
+    
+    // Flush the OOM score on a state change or on the first decision after attach
+    if (proc->oom_pending) {
+        set_oom_score(proc->pid, proc->oom_score);
+        proc->oom_pending = false;
+    }
+}
+
+ProcessState decide_state(float importance_score, int requested_priority, bool is_visible,
+                          time_t prewarm_until, time_t now) {
+    ProcessState new_state;
+    
+    if (requested_priority != 0) {
         // Use the requested priority as a strong influence
-        importance_score = (importance_score + (float)proc->requested_priority * 2.0) / 3.0;
+        importance_score = (importance_score + (float)requested_priority * 2.0) / 3.0;
     }
     
     // Determine new state based on importance score (now in -20 to 20 range)
     if (importance_score > 10) {
-        proc->state = PROCESS_STATE_CACHED;
+        new_state = PROCESS_STATE_CACHED;
     } else if (importance_score > 0) {
-        proc->state = PROCESS_STATE_BACKGROUND;
+        new_state = PROCESS_STATE_BACKGROUND;
     } else if (importance_score > -10) {
-        proc->state = PROCESS_STATE_SERVICE;
+        new_state = PROCESS_STATE_SERVICE;
     } else if (importance_score > -15) {
-        proc->state = PROCESS_STATE_VISIBLE;
+        new_state = PROCESS_STATE_VISIBLE;
     } else {
-        proc->state = PROCESS_STATE_FOREGROUND;
+        new_state = PROCESS_STATE_FOREGROUND;
     }
     
-    // Only apply changes if state changed
-    if (old_state != proc->state) {
-        const char *state_names[] = {
-            "FOREGROUND", "VISIBLE", "SERVICE", "BACKGROUND", "CACHED"
-        };
-        
-        log_message("[%s] PID %d State changed : %s -> %s (score: %.1f)", 
-                  proc->name, proc->pid, state_names[old_state], state_names[proc->state], importance_score);
-        
-        // Update cgroup assignment and OOM score
-        const char *target_cgroup = get_cgroup_for_state(proc->state);
-        int oom_score = get_oom_score_for_state(proc->state);
-        
-        if (assign_to_cgroup(target_cgroup, proc->pid) == 0) {
-            strncpy(proc->cgroup_path, target_cgroup, sizeof(proc->cgroup_path)-1);
-        } else {
-            log_message("[%s] Failed to assign to cgroup %s", proc->name, target_cgroup);
-        }
-        
-        set_oom_score(proc->pid, oom_score);
-        proc->oom_score = oom_score;
+    // An app with a window on screen is never placed below the visible tier
+    if (is_visible && new_state > PROCESS_STATE_VISIBLE) {
+        new_state = PROCESS_STATE_VISIBLE;
     }
+    
+    // A predicted next app is held out of the cached tier until its window expires
+    if (new_state == PROCESS_STATE_CACHED && now < prewarm_until) {
+        new_state = PROCESS_STATE_BACKGROUND;
+    }
+    
+    return new_state;
+}
+
+ProcessState decide_process_state(TrackedProcess *proc, float importance_score, time_t now) {
+    return decide_state(importance_score, proc->requested_priority, proc->is_visible, proc->prewarm_until, now);
+}
+
+void update_process_state(TrackedProcess *proc, float importance_score) {
+    apply_process_state(proc, decide_process_state(proc, importance_score, time(NULL)), importance_score);
 }
 
-void adjust_resource_controls(TrackedProcess *proc) {
+void adjust_resource_controls(TrackedProcess *const *members, int count) {
+    // Members share the app's cgroup; if it could not be entered, leave the tier alone
+    const TrackedProcess *leader = members[0];
+    if (!is_app_cgroup(leader->cgroup_path)) return;
+    
     char path[512];
-    float avg_cpu = calculate_average_cpu(proc);
+    float avg_cpu = 0;
+    int cpu_weight = 0;
+    long memory_limit = 0;
+    for (int i = 0; i < count; i++) {
+        avg_cpu += calculate_average_cpu(members[i]);
+        // Manifest overrides: the leader's, else the first member that has one
+        if (cpu_weight == 0) cpu_weight = members[i]->cpu_weight;
+        if (memory_limit == 0) memory_limit = members[i]->memory_limit;
+    }
     
     // CPU shares based on state and usage patterns
     int cpu_shares = 100;  // Base value
-    switch (proc->state) {
+    switch (leader->state) {
         case PROCESS_STATE_FOREGROUND:
             cpu_shares = 100;
             break;
@@ -612,41 +777,192 @@ void adjust_resource_controls(TrackedProcess *proc) {
             break;
     }
     
-    // Adjust for intensive processes
+    // Adjust for intensive apps
     if (avg_cpu > 50.0) {
         cpu_shares = (int)(cpu_shares * 1.2);
     }
     
+    // A manifest override replaces the tier default
+    if (cpu_weight > 0) {
+        cpu_shares = cpu_weight;
+    }
+    
     // Set CPU shares
-    snprintf(path, sizeof(path), "%s/cpu.weight", proc->cgroup_path);
-    FILE *f = fopen(path, "w");
-    if (f) {
-        fprintf(f, "%d", cpu_shares);
-        fclose(f);
+    FILE *f;
+    if (cgroup_capable(CGROUP_CAP_CPU)) {
+        snprintf(path, sizeof(path), "%s/cpu.weight", leader->cgroup_path);
+        f = fopen(path, "w");
+        if (f) {
+            fprintf(f, "%d", cpu_shares);
+            fclose(f);
+        }
     }
     
+    if (!cgroup_capable(CGROUP_CAP_MEMORY)) return;
+    
+    // Foreground and visible apps are shielded from reclaim
+    update_app_protection(members[0]);
+    
     // Set memory limits if under pressure
-    if (memory_pressure && proc->state >= PROCESS_STATE_BACKGROUND) {
-        long avg_mem = calculate_average_memory(proc);
-        long mem_limit = avg_mem * 1024 * 1.5;  // 1.5x current usage
+    if (memory_pressure && leader->state >= PROCESS_STATE_BACKGROUND) {
+        // The app cgroup's own charge covers untracked children; PSS is the fallback
+        long long usage = app_memory_footprint(leader);
+        if (usage < 0) {
+            time_t now = time(NULL);
+            long pss = 0;
+            for (int i = 0; i < count; i++) {
+                pss += get_process_footprint(members[i], now);
+            }
+            usage = (long long)pss * 1024;
+        }
+        long mem_limit = usage * 1.5;  // 1.5x the app's usage
+        if (memory_limit > 0 && memory_limit < mem_limit) {
+            mem_limit = memory_limit;
+        }
         
-        snprintf(path, sizeof(path), "%s/memory.max", proc->cgroup_path);
+        snprintf(path, sizeof(path), "%s/memory.max", leader->cgroup_path);
         f = fopen(path, "w");
         if (f) {
             fprintf(f, "%ld", mem_limit);
             fclose(f);
         }
     } else {
-        // Remove memory limits when not under pressure
-        snprintf(path, sizeof(path), "%s/memory.max", proc->cgroup_path);
+        // Remove memory limits when not under pressure (back to the manifest cap, if any)
+        snprintf(path, sizeof(path), "%s/memory.max", leader->cgroup_path);
         f = fopen(path, "w");
         if (f) {
-            fprintf(f, "-1");  // No limit
+            if (memory_limit > 0) {
+                fprintf(f, "%ld", memory_limit);
+            } else {
+                fprintf(f, "max");  // No limit
+            }
             fclose(f);
         }
     }
 }
 
+TrackedProcess *find_tracked_process(pid_t pid) {
+    for (int i = 0; i < process_count; i++) {
+        if (processes[i].pid == pid) return &processes[i];
+    }
+    return NULL;
+}
+
+// Walks cached parent links through the tracked table only, so no /proc reads
+static bool is_tracked_descendant(const TrackedProcess *proc, pid_t ancestor) {
+    pid_t parent = proc->ppid;
+    for (int depth = 0; depth < 16 && parent > 1; depth++) {
+        if (parent == ancestor) return true;
+        const TrackedProcess *up = find_tracked_process(parent);
+        if (!up) return false;
+        parent = up->ppid;
+    }
+    return false;
+}
+
+static pid_t fast_path_focus_pid = -1;
+static pid_t fast_path_focus_app = -1;
+
+// The focused process, its descendants and the rest of its app
+static bool in_focus_tree(const TrackedProcess *proc, pid_t pid, pid_t app_id) {
+    return proc->pid == pid || (app_id > 0 && proc->app_id == app_id) || is_tracked_descendant(proc, pid);
+}
+
+void focus_fast_path(pid_t focused_pid) {
+    if (focused_pid <= 0 || focused_pid == fast_path_focus_pid) return;
+    
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    time_t now = time(NULL);
+    pid_t previous = fast_path_focus_pid;
+    pid_t previous_app = fast_path_focus_app;
+    fast_path_focus_pid = focused_pid;
+    boost_focus_change(focused_pid);
+    
+    // A newly launched app may not be tracked yet
+    TrackedProcess *focused = find_tracked_process(focused_pid);
+    if (!focused && process_count < MAX_PROCESSES) {
+        focused = &processes[process_count];
+        initialize_process(focused, focused_pid, "foreground");
+        focused->app_id = focused_pid;
+        process_count++;
+    }
+    fast_path_focus_app = focused ? focused->app_id : -1;
+    
+    // Touch only the old and new focus trees; the regular cycle does the full rescore.
+    // The trace records every touched process so replay can follow the change
+    trace_begin_focus(now, focused_pid);
+    int promoted = 0, demoted = 0;
+    for (int i = 0; i < process_count; i++) {
+        TrackedProcess *proc = &processes[i];
+        ProcessState prev_state = proc->state;
+        if (in_focus_tree(proc, focused_pid, fast_path_focus_app)) {
+            proc->last_foreground_time = now;
+            proc->last_active = now;
+            apply_process_state(proc, PROCESS_STATE_FOREGROUND, proc->importance_score);
+            promoted++;
+        } else if (previous > 0 && proc->state == PROCESS_STATE_FOREGROUND &&
+                   in_focus_tree(proc, previous, previous_app)) {
+            apply_process_state(proc, PROCESS_STATE_VISIBLE, proc->importance_score);
+            demoted++;
+        } else {
+            continue;
+        }
+        trace_record_process(proc, prev_state, false, now);
+    }
+    trace_end_cycle();
+    
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed_ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    log_message("Focus fast path: PID %d (%d promoted, %d demoted) in %.2f ms",
+                focused_pid, promoted, demoted, elapsed_ms);
+}
+
+void wait_for_next_cycle(int interval_ms) {
+    struct pollfd fds[2 + MAX_INPUT_DEVICES];
+    int focus_fd = -1;
+    
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int remaining = interval_ms;
+    while (remaining > 0 && !should_exit) {
+        // SIGUSR1 interrupts poll(), so the report follows the signal promptly
+        if (report_requested) {
+            report_requested = false;
+            print_debug_report();
+        }
+        
+        // The provider can change mid-wait, e.g. x11 falling back after losing the server
+        focus_fd = open_focus_events();
+        int nfds = 0;
+        if (focus_fd != -1) {
+            fds[0].fd = focus_fd;
+            fds[0].events = POLLIN;
+            fds[0].revents = 0;
+            nfds = 1;
+        }
+        int input_base = nfds;
+        nfds += input_fill_pollfds(&fds[input_base], 1 + MAX_INPUT_DEVICES);
+        
+        // Wake up in time to let an interaction boost decay
+        int timeout = remaining;
+        int boost_left = input_boost_remaining_ms();
+        if (boost_left >= 0 && boost_left < timeout) timeout = boost_left;
+        
+        int ready = poll(fds, nfds, timeout);
+        if (ready > 0) {
+            handle_input_ready(&fds[input_base], nfds - input_base);
+        }
+        if (focus_fd != -1 && ((ready > 0 && fds[0].revents) || focus_events_pending())) {
+            focus_fast_path(poll_focus_event());
+        }
+        expire_input_boost();
+        
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        remaining = interval_ms - (int)((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000);
+    }
+}
+
 void update_lru_list() {
     // Sort processes by last_active time (most recent first)
     for (int i = 0; i < process_count; i++) {
@@ -660,160 +976,434 @@ void update_lru_list() {
     }
 }
 
+bool should_sample_process(TrackedProcess *proc, pid_t focused_pid, time_t now) {
+    // Foreground, visible and service tiers are always sampled
+    if (proc->state < PROCESS_STATE_BACKGROUND) return true;
+    
+    // Audio playback keeps a process important
+    if (is_audio_owner(proc->pid) || proc->is_playing_audio) return true;
+    
+    // Promotion candidates: the focus tree and predicted next apps
+    if (proc->pid == focused_pid || is_tracked_descendant(proc, focused_pid)) return true;
+    if (now < proc->prewarm_until) return true;
+    
+    // Over the overhead budget, the remaining triggers fire less often for cached processes
+    if (proc->state == PROCESS_STATE_CACHED && overhead_level() >= OVERHEAD_LEVEL_SLOW_CACHED &&
+        now - proc->sampled_at < OVERHEAD_CACHED_SAMPLE_SECS) {
+        return false;
+    }
+    
+    // Kill candidates under memory pressure
+    if (proc->state == PROCESS_STATE_CACHED &&
+        (memory_pressure || tier_under_memory_pressure(PROCESS_STATE_CACHED))) {
+        return true;
+    }
+    
+    // Something in the tier is busy; find out who
+    return get_tier_cpu_percent(proc->state) >= TIER_ACTIVE_CPU_PERCENT;
+}
+
 void monitor_all_processes() {
     time_t now = time(NULL);
     pid_t focused_pid = get_focused_window_pid();
     
-    log_message("Current focused PID: %d", focused_pid);
+    bool detail = overhead_log_detail();
+    if (detail) log_message("Current focused PID: %d", focused_pid);
+    
+    // Learn focus transitions and pre-warm the likely next app
+    predictor_observe_focus(focused_pid, now);
+    boost_focus_change(focused_pid);
+    
+    // Find the processes behind running playback streams
+    scan_audio_owners();
     
-    // Check system memory pressure
+    // Tier-level accounting covers every member in a few reads per tier
+    update_tier_accounting();
+    
+    // Check memory pressure from the tiers' memory events and the system PSI
     memory_pressure = check_memory_pressure();
     if (memory_pressure) {
         log_message("SYSTEM: Memory pressure detected");
     }
+    update_tier_protection();
+    update_swap_policy();
+    
+    // Cap the low tiers before the firmware has to throttle
+    if (update_thermal_state() >= 0 && detail) {
+        log_message("Thermal headroom: %.1fC (throttle level %d)",
+                    get_thermal_headroom_mc() / 1000.0, get_thermal_level());
+    }
+    
+    // Apps with a window on screen but not focus, e.g. a video on a second monitor
+    pid_t visible_pids[MAX_CLIENT_WINDOWS];
+    int visible_count = get_visible_pids(visible_pids, MAX_CLIENT_WINDOWS);
+    for (int i = 0; i < process_count; i++) {
+        TrackedProcess *proc = &processes[i];
+        proc->is_visible = false;
+        for (int v = 0; v < visible_count && !proc->is_visible; v++) {
+            if (visible_pids[v] == focused_pid) continue;
+            proc->is_visible = (proc->pid == visible_pids[v] || is_tracked_descendant(proc, visible_pids[v]));
+        }
+    }
+    if (visible_count > 0 && detail) {
+        log_message("Visible windows: %d apps on screen", visible_count);
+    }
+    
+    trace_begin_cycle(now, focused_pid, memory_pressure);
     
     // Update process metrics and calculate importance
+    ProcessState prev_states[MAX_PROCESSES];
+    bool sampled_now[MAX_PROCESSES];
+    int sampled = 0;
     for (int i = 0; i < process_count; i++) {
-        // Update process resources and metrics
-        update_resource_history(&processes[i]);
+        prev_states[i] = processes[i].state;
         
-        // Calculate importance score
-        float importance = calculate_importance_score(&processes[i], focused_pid);
-        processes[i].importance_score = importance;
+        // Update process resources and metrics (idle low tiers keep their last sample)
+        sampled_now[i] = should_sample_process(&processes[i], focused_pid, now);
+        if (sampled_now[i]) {
+            update_resource_history(&processes[i], now);
+            processes[i].sampled_at = now;
+            sampled++;
+        }
         
-        // Update process state based on importance
-        update_process_state(&processes[i], importance);
+        // Calculate importance score
+        processes[i].importance_score = calculate_importance_score(&processes[i], focused_pid, now);
+    }
+    
+    // One decision per app, applied to all of its processes together
+    update_app_groups();
+    int apps = 0;
+    for (int i = 0; i < process_count; i++) {
+        if (processes[i].app_id != processes[i].pid) continue;
         
-        // Adjust resource controls
-        adjust_resource_controls(&processes[i]);
+        TrackedProcess *members[MAX_PROCESSES];
+        int count = get_app_members(processes[i].pid, members, MAX_PROCESSES);
+        float app_score;
+        ProcessState state = decide_app_state(members, count, now, &app_score);
+        for (int m = 0; m < count; m++) {
+            apply_process_state(members[m], state, app_score);
+        }
+        adjust_resource_controls(members, count);
+        apps++;
+    }
+    
+    // Let ksmd merge cached apps' pages, and only while there are some
+    update_ksm();
+    
+    for (int i = 0; i < process_count; i++) {
+        trace_record_process(&processes[i], prev_states[i], sampled_now[i], now);
         
         // Debug output
-        log_message("Process [%s] PID %d: Score=%.1f, State=%d, CPU=%.1f%%", 
-                  processes[i].name, processes[i].pid, 
-                  processes[i].importance_score, processes[i].state,
-                  calculate_average_cpu(&processes[i]));
+        if (detail) {
+            log_message("Process [%s] PID %d: Score=%.1f, State=%d, CPU=%.1f%%", 
+                      processes[i].name, processes[i].pid, 
+                      processes[i].importance_score, processes[i].state,
+                      calculate_average_cpu(&processes[i]));
+        }
     }
     
+    if (detail) {
+        log_message("Sampled %d of %d processes individually, %d apps", sampled, process_count, apps);
+    }
+    trace_end_cycle();
+    
     // Update LRU list for potential low-memory situations
     update_lru_list();
     
-    // If severe memory pressure, proactively kill low-priority processes
+    // If severe memory pressure, proactively kill whole cached apps that
+    // haven't been active in a while (5 minutes)
     if (memory_pressure) {
         for (int i = 0; i < process_count; i++) {
-            if (processes[i].state == PROCESS_STATE_CACHED) {
-                // Only kill cached processes that haven't been active in a while
-                if (now - processes[i].last_active > 300) {  // 5 minutes
-                    log_message("Memory pressure: Killing cached process [%s] PID %d", 
-                               processes[i].name, processes[i].pid);
-                    kill(processes[i].pid, SIGTERM);
-                    // Process will be removed from array in the main loop
-                }
+            if (processes[i].app_id == processes[i].pid && processes[i].state == PROCESS_STATE_CACHED) {
+                kill_idle_cached_app(processes[i].pid, now);
             }
         }
     }
 }
 
-void initialize_process(TrackedProcess *proc, pid_t pid, const char *initial_group) {
-    memset(proc, 0, sizeof(TrackedProcess));
-    proc->pid = pid;
-    proc->last_active = time(NULL);
-    proc->last_foreground_time = time(NULL);
-    proc->requested_priority = 0;
-    
-    // Set initial state based on group
-    if (strcmp(initial_group, "foreground") == 0) {
-        proc->state = PROCESS_STATE_FOREGROUND;
-        strncpy(proc->cgroup_path, CGROUP_FOREGROUND, sizeof(proc->cgroup_path)-1);
-    } else {
-        proc->state = PROCESS_STATE_BACKGROUND;
-        strncpy(proc->cgroup_path, CGROUP_BACKGROUND, sizeof(proc->cgroup_path)-1);
+bool read_process_snapshot(TrackedProcess *proc, pid_t pid, bool *is_kthread) {
+    char path[256];
+    char buf[1024];
+    *is_kthread = false;
+    
+    // A single read of stat gives name, parent, session, flags and start time
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return false;
+    ssize_t len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0) return false;
+    buf[len] = '\0';
+    
+    // comm is wrapped in parentheses and may itself contain spaces or ')'
+    char *name_start = strchr(buf, '(');
+    char *name_end = strrchr(buf, ')');
+    if (!name_start || !name_end || name_end < name_start) return false;
+    
+    char state;
+    int ppid, sid;
+    unsigned int flags;
+    unsigned long long start_time;
+    if (sscanf(name_end + 2, "%c %d %*d %d %*d %*d %u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %llu",
+               &state, &ppid, &sid, &flags, &start_time) != 5) {
+        return false;
     }
     
-    // Get process name
-    char path[256];
-    snprintf(path, sizeof(path), "/proc/%d/comm", pid);
-    FILE *f = fopen(path, "r");
-    if (f) {
-        if (fgets(proc->name, sizeof(proc->name), f)) {
-            // Remove trailing newline
-            size_t len = strlen(proc->name);
-            if (len > 0 && proc->name[len-1] == '\n')
-                proc->name[len-1] = '\0';
-        }
-        fclose(f);
+    // Kernel threads ignore cgroup moves and oom_score_adj writes
+    if ((flags & PF_KTHREAD_FLAG) || ppid == 2) {
+        *is_kthread = true;
+        return false;
+    }
+    if (state == 'Z') return false;
+    
+    size_t name_len = name_end - name_start - 1;
+    if (name_len > sizeof(proc->name) - 1) name_len = sizeof(proc->name) - 1;
+    memcpy(proc->name, name_start + 1, name_len);
+    proc->name[name_len] = '\0';
+    proc->ppid = ppid;
+    proc->sid = sid;
+    proc->start_time = start_time;
+    
+    // Classify once from the systemd cgroup; the result is cached for the
+    // process lifetime since our own tier moves overwrite /proc/<pid>/cgroup
+    CgroupClass cls = CGROUP_CLASS_UNKNOWN;
+    if (read_origin_cgroup(pid, proc->origin_cgroup, sizeof(proc->origin_cgroup)) == 0) {
+        cls = classify_cgroup_path(proc->origin_cgroup);
+        proc->is_system_service = (cls == CGROUP_CLASS_SERVICE);
+        proc->app_scope = (cls == CGROUP_CLASS_APP && app_unit_length(proc->origin_cgroup) > 0);
     }
     
-    // Get command line
+    // One read of cmdline serves both the display copy and the fallback heuristic
     snprintf(path, sizeof(path), "/proc/%d/cmdline", pid);
-    f = fopen(path, "r");
-    if (f) {
-        size_t bytes = fread(proc->cmdline, 1, sizeof(proc->cmdline)-1, f);
+    fd = open(path, O_RDONLY);
+    if (fd != -1) {
+        ssize_t bytes = read(fd, proc->cmdline, sizeof(proc->cmdline) - 1);
+        close(fd);
         if (bytes > 0) {
             proc->cmdline[bytes] = '\0';
+            if (cls == CGROUP_CLASS_UNKNOWN) {
+                proc->is_system_service = cmdline_is_system_service(proc->cmdline, bytes);
+            }
             // Replace null bytes with spaces for readability
-            for (size_t i = 0; i < bytes; i++) {
+            for (ssize_t i = 0; i < bytes; i++) {
                 if (proc->cmdline[i] == '\0') proc->cmdline[i] = ' ';
             }
         }
-        fclose(f);
     }
+    return true;
+}
+
+static void init_tracking_defaults(TrackedProcess *proc, pid_t pid, const char *initial_group) {
+    memset(proc, 0, sizeof(TrackedProcess));
+    proc->pid = pid;
+    proc->last_active = time(NULL);
+    proc->last_foreground_time = time(NULL);
+    proc->requested_priority = 0;
+    
+    // Set initial state based on group (unknown names fall back to background)
+    if (!parse_state_name(initial_group, &proc->state)) {
+        proc->state = PROCESS_STATE_BACKGROUND;
+    }
+    strncpy(proc->cgroup_path, get_cgroup_for_state(proc->state), sizeof(proc->cgroup_path)-1);
     
-    // Check if system service
-    proc->is_system_service = is_system_service(pid);
+    proc->pidfd = -1;
+    
+    // The OOM score is written on the first decision, not at attach time
+    proc->oom_score = get_oom_score_for_state(proc->state);
+    proc->oom_pending = true;
+}
+
+void initialize_process(TrackedProcess *proc, pid_t pid, const char *initial_group) {
+    init_tracking_defaults(proc, pid, initial_group);
     
-    // Set initial OOM score
-    int oom_score = get_oom_score_for_state(proc->state);
-    set_oom_score(pid, oom_score);
-    proc->oom_score = oom_score;
+    bool is_kthread;
+    read_process_snapshot(proc, pid, &is_kthread);
     
     log_message("Initialized process [%s] PID %d in %s", proc->name, pid, initial_group);
 }
 
-void launch_and_track_process(const char *group, char *const argv[]) {
-    if (process_count >= MAX_PROCESSES) {
-        log_message("Too many processes tracked.");
-        return;
-    }
+#ifndef CLONE_PIDFD
+#define CLONE_PIDFD 0x00001000
+#endif
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
 
-    pid_t pid = fork();
-    if (pid == -1) {
-        perror("fork");
-        return;
+// Layout of struct clone_args (CLONE_ARGS_SIZE_VER2), kept local so older
+// kernel headers still build
+typedef struct {
+    uint64_t flags;
+    uint64_t pidfd;
+    uint64_t child_tid;
+    uint64_t parent_tid;
+    uint64_t exit_signal;
+    uint64_t stack;
+    uint64_t stack_size;
+    uint64_t tls;
+    uint64_t set_tid;
+    uint64_t set_tid_size;
+    uint64_t cgroup;
+} LaunchCloneArgs;
+
+static void report_exec_failure(int err_fd) {
+    int err = errno;
+    if (write(err_fd, &err, sizeof(err)) < 0) {
+        // Nothing left to report to
     }
+    _exit(127);
+}
 
-    if (pid == 0) { // child
-        const char *target_group = strcmp(group, "foreground") == 0 ? CGROUP_FOREGROUND : CGROUP_BACKGROUND;
-        if (assign_to_cgroup(target_group, getpid()) != 0) {
-            log_message("Failed to assign to cgroup.");
-            exit(1);
+pid_t spawn_into_cgroup(const char *cgroup_path, char *const argv[], int *pidfd_out) {
+    *pidfd_out = -1;
+    
+    // The close-on-exec pipe carries the child's errno if exec fails and
+    // reaches EOF once exec succeeds
+    int err_pipe[2];
+    if (pipe2(err_pipe, O_CLOEXEC) == -1) {
+        log_message("Failed to create launch pipe: %s", strerror(errno));
+        return -1;
+    }
+    
+    pid_t pid = -1;
+#ifdef SYS_clone3
+    int cgroup_fd = open(cgroup_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cgroup_fd != -1) {
+        // The child is born directly inside the target cgroup
+        int pidfd = -1;
+        LaunchCloneArgs args;
+        memset(&args, 0, sizeof(args));
+        args.flags = CLONE_INTO_CGROUP | CLONE_PIDFD;
+        args.pidfd = (uint64_t)(uintptr_t)&pidfd;
+        args.exit_signal = SIGCHLD;
+        args.cgroup = (uint64_t)cgroup_fd;
+        
+        pid = syscall(SYS_clone3, &args, sizeof(args));
+        if (pid == 0) {
+            ksm_opt_in_child();
+            execvp(argv[0], argv);
+            report_exec_failure(err_pipe[1]);
+        }
+        close(cgroup_fd);
+        if (pid > 0) {
+            *pidfd_out = pidfd;
+        } else {
+            log_message("clone3 into %s unavailable (%s), falling back to fork", cgroup_path, strerror(errno));
         }
-        execvp(argv[0], argv);
-        perror("execvp");
-        exit(1);
-    } else { // parent
-        initialize_process(&processes[process_count], pid, group);
-        process_count++;
-        log_message("Process started with PID %d", pid);
     }
+#endif
+    
+    if (pid <= 0) {
+        pid = fork();
+        if (pid == -1) {
+            log_message("fork failed: %s", strerror(errno));
+            close(err_pipe[0]);
+            close(err_pipe[1]);
+            return -1;
+        }
+        if (pid == 0) {
+            if (assign_to_cgroup(cgroup_path, getpid()) != 0) {
+                report_exec_failure(err_pipe[1]);
+            }
+            ksm_opt_in_child();
+            execvp(argv[0], argv);
+            report_exec_failure(err_pipe[1]);
+        }
+#ifdef SYS_pidfd_open
+        *pidfd_out = syscall(SYS_pidfd_open, pid, 0);
+#endif
+    }
+    
+    close(err_pipe[1]);
+    int child_err = 0;
+    ssize_t n;
+    do {
+        n = read(err_pipe[0], &child_err, sizeof(child_err));
+    } while (n == -1 && errno == EINTR);
+    close(err_pipe[0]);
+    
+    if (n == sizeof(child_err)) {
+        log_message("Failed to launch %s: %s", argv[0], strerror(child_err));
+        waitpid(pid, NULL, 0);
+        if (*pidfd_out >= 0) close(*pidfd_out);
+        *pidfd_out = -1;
+        return -1;
+    }
+    return pid;
 }
 
-void setup_cgroups() {
-    // This function assumes cgroups are already mounted at /sys/fs/cgroup
-    // Create cgroup directories if they don't exist
-    const char *cgroups[] = {
-        CGROUP_FOREGROUND, CGROUP_VISIBLE, CGROUP_SERVICE, 
-        CGROUP_BACKGROUND, CGROUP_CACHED
-    };
+pid_t launch_and_track_process(const char *group, char *const argv[]) {
+    if (process_count >= MAX_PROCESSES) {
+        log_message("Too many processes tracked.");
+        return -1;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
     
-    for (int i = 0; i < 5; i++) {
-        mkdir(cgroups[i], 0755);
-        log_message("Created cgroup directory: %s", cgroups[i]);
+    ProcessState initial_state;
+    if (!parse_state_name(group, &initial_state)) {
+        initial_state = PROCESS_STATE_BACKGROUND;
+    }
+    // Spawn into the tier's staging cgroup; the first decision moves it to its app's cgroup
+    char launch_cgroup[256];
+    snprintf(launch_cgroup, sizeof(launch_cgroup), "%s/" LAUNCH_CGROUP, get_cgroup_for_state(initial_state));
+    int pidfd;
+    pid_t pid = spawn_into_cgroup(launch_cgroup, argv, &pidfd);
+    if (pid == -1) {
+        return -1;
     }
     
-    log_message("cgroup hierarchy initialized");
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed_ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    
+    initialize_process(&processes[process_count], pid, group);
+    strncpy(processes[process_count].cgroup_path, launch_cgroup, sizeof(processes[process_count].cgroup_path)-1);
+    processes[process_count].pidfd = pidfd;
+    processes[process_count].launched = true;
+    processes[process_count].launch_ms = elapsed_ms;
+    process_count++;
+    log_message("Process started with PID %d in %.2f ms", pid, elapsed_ms);
+    return pid;
+}
+
+// Shared work queue for the parallel startup scan
+typedef struct {
+    pid_t *pids;
+    int npids;
+    int next;
+    int kthreads_skipped;
+} AttachScan;
+
+static void *attach_worker(void *arg) {
+    AttachScan *scan = (AttachScan *)arg;
+    TrackedProcess snapshot;
+    
+    while (true) {
+        int i = __sync_fetch_and_add(&scan->next, 1);
+        if (i >= scan->npids) break;
+        
+        bool is_kthread;
+        init_tracking_defaults(&snapshot, scan->pids[i], "background");
+        if (!read_process_snapshot(&snapshot, scan->pids[i], &is_kthread)) {
+            if (is_kthread) __sync_fetch_and_add(&scan->kthreads_skipped, 1);
+            continue;
+        }
+        
+        // Claim a slot only once the snapshot is complete
+        int slot = __sync_fetch_and_add(&process_count, 1);
+        if (slot >= MAX_PROCESSES) {
+            __sync_fetch_and_sub(&process_count, 1);
+            break;
+        }
+        processes[slot] = snapshot;
+    }
+    return NULL;
 }
 
 void attach_to_existing_processes() {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
     // Find running processes and attach to them
     DIR *dir = opendir("/proc");
     if (!dir) {
@@ -821,27 +1411,59 @@ void attach_to_existing_processes() {
         return;
     }
     
+    AttachScan scan;
+    memset(&scan, 0, sizeof(scan));
+    int capacity = 512;
+    scan.pids = (pid_t *)malloc(capacity * sizeof(pid_t));
+    if (!scan.pids) {
+        closedir(dir);
+        return;
+    }
+    
     struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL && process_count < MAX_PROCESSES) {
+    pid_t self = getpid();
+    while ((entry = readdir(dir)) != NULL) {
         // Check if this is a process directory (numeric name)
         pid_t pid = atoi(entry->d_name);
         if (pid <= 0) continue;
         
-        // Skip kernel threads and our own process
-        if (pid == 1 || pid == getpid()) continue;
-        
-        // Check if process still exists
-        char path[256];
-        snprintf(path, sizeof(path), "/proc/%d", pid);
-        if (access(path, F_OK) != 0) continue;
+        // Skip init and our own process; kernel threads are filtered by the workers
+        if (pid == 1 || pid == self) continue;
         
-        // Initialize the process
-        initialize_process(&processes[process_count], pid, "background");
-        process_count++;
+        if (scan.npids == capacity) {
+            capacity *= 2;
+            pid_t *grown = (pid_t *)realloc(scan.pids, capacity * sizeof(pid_t));
+            if (!grown) break;
+            scan.pids = grown;
+        }
+        scan.pids[scan.npids++] = pid;
     }
-    
     closedir(dir);
-    log_message("Attached to %d existing processes", process_count);
+    
+    // Spread the per-process reads across workers; the calling thread joins in
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int workers = (cpus > 0) ? (int)cpus : 1;
+    if (workers > ATTACH_MAX_WORKERS) workers = ATTACH_MAX_WORKERS;
+    if (workers > scan.npids / 32 + 1) workers = scan.npids / 32 + 1;
+    
+    pthread_t threads[ATTACH_MAX_WORKERS];
+    int started = 0;
+    for (int i = 1; i < workers; i++) {
+        if (pthread_create(&threads[started], NULL, attach_worker, &scan) == 0) {
+            started++;
+        }
+    }
+    attach_worker(&scan);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    
+    free(scan.pids);
+    
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed_ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    log_message("Attached to %d existing processes in %.1f ms (%d workers, %d kernel threads skipped)",
+                process_count, elapsed_ms, started + 1, scan.kthreads_skipped);
 }
 
 bool are_processes_related(pid_t pid1, pid_t pid2) {
@@ -886,27 +1508,52 @@ bool check_ipc_connections(pid_t pid1, pid_t pid2) {
     return false;
 }
 
+bool shutdown_requested(void) {
+    return should_exit;
+}
+
+void print_debug_report(void) {
+    for (int i = 0; i < process_count; i++) {
+        log_message("DEBUG: Process %d [%s] State=%d Score=%.1f LastActive=%ld",
+                  processes[i].pid, processes[i].name, processes[i].state, 
+                  processes[i].importance_score, processes[i].last_active);
+    }
+    tier_accounting_report();
+    swap_report();
+    ksm_report();
+    overhead_report();
+    thermal_report();
+    cgroup_report();
+    predictor_report();
+    input_report();
+    log_message("Focus provider: %s", focus_provider_name());
+}
+
 void handle_signal(int sig) {
     if (sig == SIGUSR1) {
-        // Print debug information
-        for (int i = 0; i < process_count; i++) {
-            log_message("DEBUG: Process %d [%s] State=%d Score=%.1f LastActive=%ld",
-                      processes[i].pid, processes[i].name, processes[i].state, 
-                      processes[i].importance_score, processes[i].last_active);
-        }
+        // The reports use stdio and /proc, so they are printed outside the handler
+        report_requested = true;
     } else if (sig == SIGTERM || sig == SIGINT) {
-        log_message("Shutdown signal received, cleaning up...");
-        
-        // Move all processes back to default cgroup
-        for (int i = 0; i < process_count; i++) {
-            assign_to_cgroup("/sys/fs/cgroup", processes[i].pid);
-            set_oom_score(processes[i].pid, 0);  // Reset OOM score
-        }
-        
+        // Cleanup runs in the main loop once it observes the flag
+        should_exit = true;
+    } else if (sig == SIGUSR2) {
+        // Handover to a new instance: keep cgroup placements and OOM scores
+        handover_requested = true;
         should_exit = true;
     }
 }
 
+void release_placements() {
+    log_message("Shutdown signal received, cleaning up...");
+    
+    // Move all processes back to default cgroup
+    for (int i = 0; i < process_count; i++) {
+        assign_to_cgroup(CGROUP_ROOT, processes[i].pid);
+        set_oom_score(processes[i].pid, 0);  // Reset OOM score
+        remove_app_cgroup(processes[i].cgroup_path);
+    }
+}
+
 void setup_priority_change_service() {
     // Simplified - would create named pipe for priority changes
     log_message("Priority change service started");
@@ -922,17 +1569,49 @@ int android_scheduler_main(int argc, char *argv[]) {
     signal(SIGUSR1, handle_signal);
     signal(SIGTERM, handle_signal);
     signal(SIGINT, handle_signal);
+    signal(SIGUSR2, handle_signal);
     
     log_message("Android Process Scheduler starting");
     
+    // Offline replay touches neither cgroups nor processes
+    if (argc >= 2 && strcmp(argv[1], "replay") == 0) {
+        if (argc < 3) {
+            log_message("Error: No trace file specified");
+            return 1;
+        }
+        return replay_trace(argv[2]) == 0 ? 0 : 1;
+    }
+    if (argc >= 2 && strcmp(argv[1], "bench") == 0) {
+        int cycles = (argc >= 3 && atoi(argv[2]) > 0) ? atoi(argv[2]) : BENCH_DEFAULT_CYCLES;
+        return run_policy_benchmark(cycles) == 0 ? 0 : 1;
+    }
+    
+    // Recording wraps any other mode: strip "record <trace>" and carry on
+    if (argc >= 2 && strcmp(argv[1], "record") == 0) {
+        if (argc < 3) {
+            log_message("Error: No trace file specified");
+            return 1;
+        }
+        if (trace_open(argv[2]) != 0) {
+            return 1;
+        }
+        argv += 2;
+        argc -= 2;
+    }
+    
     // Reset global variables
     process_count = 0;
     memory_pressure = false;
     should_exit = false;
+    handover_requested = false;
     
     // Setup cgroups and services
     setup_cgroups();
+    init_uclamp();
+    setup_swap_policy();
+    setup_ksm();  // Before any launch, so launched apps can opt in
     setup_priority_change_service();
+    load_service_rules(SERVICE_RULES_FILE);
     
     if (argc < 2) {
         // No process specified, attach to all existing processes
@@ -941,59 +1620,104 @@ int android_scheduler_main(int argc, char *argv[]) {
     } else {
         // Launch specified processes
         char *group = argv[1];
-        if (strcmp(group, "foreground") == 0 || strcmp(group, "background") == 0) {
+        ProcessState initial_state;
+        if (strcmp(group, "manifest") == 0) {
+            if (argc < 3) {
+                log_message("Error: No manifest file specified");
+                return 1;
+            }
+            if (launch_manifest(argv[2]) != 0) {
+                return 1;
+            }
+        } else if (parse_state_name(group, &initial_state)) {
             if (argc < 3) {
                 log_message("Error: No command specified for %s group", group);
                 return 1;
             }
             launch_and_track_process(group, &argv[2]);
         } else {
-            log_message("Error: Invalid group '%s'. Use 'foreground' or 'background'", group);
+            log_message("Error: Invalid group '%s'. Use a tier name (foreground, visible, service, background, cached) or 'manifest'", group);
             return 1;
         }
     }
     
+    open_input_devices();
+    setup_overhead_governor();
+    
+    // Pick up learned history (and, after a handover, placements) from the last run
+    restore_state();
+    
     // Main monitoring loop
     log_message("Android Process Scheduler running - press Ctrl+C to exit");
+    int cycle = 0;
     while (!should_exit) {
         // Check for exited processes
         for (int i = 0; i < process_count; i++) {
-            int status;
-            pid_t result = waitpid(processes[i].pid, &status, WNOHANG);
+            TrackedProcess *proc = &processes[i];
+            bool gone = false;
             
-            if (result == processes[i].pid) {
-                log_message("[%s] exited.", processes[i].name);
-                // Replace with last element and decrease count
-                processes[i] = processes[--process_count];
-                i--;
-                continue;
-            } else if (result == -1 && errno == ECHILD) {
-                // Process doesn't exist anymore
-                log_message("[%s] no longer exists.", processes[i].name);
-                processes[i] = processes[--process_count];
-                i--;
-                continue;
+            if (proc->pidfd >= 0) {
+                // A pidfd becomes readable once the process has exited
+                struct pollfd pfd = { proc->pidfd, POLLIN, 0 };
+                gone = (poll(&pfd, 1, 0) > 0);
+            } else {
+                char path[256];
+                snprintf(path, sizeof(path), "/proc/%d", proc->pid);
+                gone = (access(path, F_OK) != 0);
+            }
+            
+            // Only our own children can (and must) be reaped
+            if (proc->launched) {
+                int status;
+                if (waitpid(proc->pid, &status, WNOHANG) == proc->pid) gone = true;
             }
             
-            // Check if process still exists
-            char path[256];
-            snprintf(path, sizeof(path), "/proc/%d", processes[i].pid);
-            if (access(path, F_OK) != 0) {
-                log_message("[%s] vanished.", processes[i].name);
+            if (gone) {
+                log_message("[%s] exited.", proc->name);
+                if (proc->pidfd >= 0) close(proc->pidfd);
+                if (proc->launched) overhead_discard_children();
+                remove_app_cgroup(proc->cgroup_path);
+                // Replace with last element and decrease count
                 processes[i] = processes[--process_count];
                 i--;
-                continue;
             }
         }
 
         check_priority_requests();
         
-        // Monitor and adjust all tracked processes
+        // Monitor and adjust all tracked processes, within the overhead budget
+        overhead_begin_cycle();
         monitor_all_processes();
+        overhead_end_cycle();
+        
+        // Checkpoint learned state periodically
+        if (++cycle % STATE_SAVE_CYCLES == 0) {
+            save_state(false, false);
+            prune_app_cgroups();
+        }
         
-        // Sleep for monitoring interval
-        sleep(MONITOR_INTERVAL);
+        // Sleep for monitoring interval, handling focus changes as they arrive
+        wait_for_next_cycle(MONITOR_INTERVAL * 1000);
+    }
+    
+    if (handover_requested) {
+        log_message("Handover requested, leaving cgroup placements in place");
+        save_state(true, true);
+    } else {
+        release_placements();
+        save_state(false, true);
     }
+    close_state();
+    trace_close();
+    close_focus_events();
+    close_input_devices();
+    close_ksm();
+    close_uclamp();
+    close_thermal();
+    overhead_report();
+    close_overhead_governor();
+    predictor_report();
+    input_report();
     
     log_message("Android Process Scheduler shutting down");
     return 0;
@@ -0,0 +1,215 @@
+#include "android_scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+/*
+ * Self-overhead governor
+ *
+ * A scheduler daemon must never become the top CPU consumer. After each
+ * cycle the monitor measures its own cost:
+ *
+ *   - CPU: getrusage() for the whole process plus its reaped children (the
+ *     ps probes), over the full interval including the wait loop, as a % of
+ *     one core. The monitor cycle itself is timed with CLOCK_THREAD_CPUTIME_ID.
+ *   - syscalls: syscr + syscw from /proc/self/io. getrusage() has no syscall
+ *     counter, and reads and writes are almost all the monitor does.
+ *
+ * The CPU figure is smoothed and compared with the budget (OVERHEAD_BUDGET_PCT,
+ * or ANDROID_SCHED_CPU_BUDGET in % of one core). Over budget, the governor
+ * degrades one level per cycle:
+ *
+ *   1. cached processes are sampled at most every OVERHEAD_CACHED_SAMPLE_SECS
+ *   2. expensive probes stop: DRM fd walks, /proc/<pid>/net and
+ *      smaps_rollup. Cached results are kept, and never-probed processes
+ *      go without.
+ *   3. per-cycle and per-process logging is shed
+ *
+ * A level is released after OVERHEAD_RELAX_CYCLES cycles below half the budget.
+ * The figures are exported to OVERHEAD_FILE each cycle in "key value" lines.
+ */
+
+#define OVERHEAD_EWMA_WEIGHT 0.3     // Weight of the newest cycle in the smoothed figure
+
+static double budget_pct = OVERHEAD_BUDGET_PCT;
+static int level = OVERHEAD_LEVEL_NORMAL;
+static int calm_cycles = 0;
+static bool discard_children = false;
+
+// Baseline at the end of the previous cycle
+static double last_wall_ms = 0;
+static double last_self_ms = 0;
+static double last_children_ms = 0;
+static unsigned long long last_syscalls = 0;
+static double thread_start_ms = 0;
+
+// Figures for the last cycle
+static double cpu_pct = 0;
+static double smoothed_pct = -1;
+static double cycle_ms = 0;
+static unsigned long long cycle_syscalls = 0;
+static unsigned long cycles = 0;
+static unsigned long over_budget_cycles = 0;
+
+static int export_fd = -1;
+
+static double clock_ms(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static double rusage_ms(int who) {
+    struct rusage usage;
+    if (getrusage(who, &usage) != 0) return 0;
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+}
+
+static unsigned long long read_syscalls(void) {
+    char buf[512];
+    int fd = open("/proc/self/io", O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return 0;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) return 0;
+    buf[n] = '\0';
+
+    unsigned long long syscr = 0, syscw = 0;
+    const char *line = strstr(buf, "syscr: ");
+    if (line) syscr = strtoull(line + 7, NULL, 10);
+    line = strstr(buf, "syscw: ");
+    if (line) syscw = strtoull(line + 7, NULL, 10);
+    return syscr + syscw;
+}
+
+static void take_baseline(void) {
+    last_wall_ms = clock_ms(CLOCK_MONOTONIC);
+    last_self_ms = rusage_ms(RUSAGE_SELF);
+    last_children_ms = rusage_ms(RUSAGE_CHILDREN);
+    last_syscalls = read_syscalls();
+}
+
+void setup_overhead_governor(void) {
+    const char *env = getenv("ANDROID_SCHED_CPU_BUDGET");
+    if (env && atof(env) > 0) budget_pct = atof(env);
+
+    char dir[256];
+    strncpy(dir, OVERHEAD_FILE, sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = '\0';
+    char *slash = strrchr(dir, '/');
+    if (slash) {
+        *slash = '\0';
+        mkdir(dir, 0755);
+    }
+    export_fd = open(OVERHEAD_FILE, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (export_fd == -1) {
+        log_message("Overhead: cannot export to %s: %s", OVERHEAD_FILE, strerror(errno));
+    }
+
+    take_baseline();
+    log_message("Overhead budget: %.2f%% of one core", budget_pct);
+}
+
+void close_overhead_governor(void) {
+    if (export_fd != -1) {
+        close(export_fd);
+        unlink(OVERHEAD_FILE);
+        export_fd = -1;
+    }
+}
+
+// Reaping a launched app adds its whole lifetime to RUSAGE_CHILDREN
+void overhead_discard_children(void) {
+    discard_children = true;
+}
+
+void overhead_begin_cycle(void) {
+    thread_start_ms = clock_ms(CLOCK_THREAD_CPUTIME_ID);
+}
+
+static void export_overhead(void) {
+    if (export_fd == -1) return;
+    char buf[256];
+    int len = snprintf(buf, sizeof(buf),
+                       "cpu_percent %.3f\nsmoothed_percent %.3f\nbudget_percent %.3f\n"
+                       "cycle_ms %.3f\nsyscalls %llu\nlevel %d\n",
+                       cpu_pct, smoothed_pct, budget_pct, cycle_ms, cycle_syscalls, level);
+    if (pwrite(export_fd, buf, len, 0) != len || ftruncate(export_fd, len) != 0) {
+        log_message("Overhead: export to %s failed: %s", OVERHEAD_FILE, strerror(errno));
+        close(export_fd);
+        export_fd = -1;
+    }
+}
+
+void overhead_end_cycle(void) {
+    cycle_ms = clock_ms(CLOCK_THREAD_CPUTIME_ID) - thread_start_ms;
+
+    double wall_ms = clock_ms(CLOCK_MONOTONIC);
+    double self_ms = rusage_ms(RUSAGE_SELF);
+    double children_ms = rusage_ms(RUSAGE_CHILDREN);
+    unsigned long long syscalls = read_syscalls();
+
+    double used_ms = self_ms - last_self_ms;
+    if (!discard_children) used_ms += children_ms - last_children_ms;
+    discard_children = false;
+
+    double window_ms = wall_ms - last_wall_ms;
+    cpu_pct = (window_ms > 0) ? 100.0 * used_ms / window_ms : 0;
+    cycle_syscalls = syscalls >= last_syscalls ? syscalls - last_syscalls : 0;
+    smoothed_pct = (smoothed_pct < 0) ? cpu_pct
+                 : OVERHEAD_EWMA_WEIGHT * cpu_pct + (1 - OVERHEAD_EWMA_WEIGHT) * smoothed_pct;
+    cycles++;
+
+    // One step down per cycle over budget; one step back after a calm stretch
+    if (smoothed_pct > budget_pct) {
+        over_budget_cycles++;
+        calm_cycles = 0;
+        if (level < OVERHEAD_LEVEL_QUIET) {
+            level++;
+            log_message("Overhead %.2f%% over the %.2f%% budget, degrading to level %d",
+                        smoothed_pct, budget_pct, level);
+        }
+    } else if (smoothed_pct < budget_pct / 2 && level > OVERHEAD_LEVEL_NORMAL) {
+        if (++calm_cycles >= OVERHEAD_RELAX_CYCLES) {
+            level--;
+            calm_cycles = 0;
+            log_message("Overhead %.2f%% back under budget, relaxing to level %d", smoothed_pct, level);
+        }
+    } else {
+        calm_cycles = 0;
+    }
+
+    export_overhead();
+
+    // Baseline after the export so its own syscalls count towards the next cycle
+    last_wall_ms = wall_ms;
+    last_self_ms = self_ms;
+    last_children_ms = children_ms;
+    last_syscalls = syscalls;
+}
+
+int overhead_level(void) {
+    return level;
+}
+
+bool overhead_shed_probes(void) {
+    return level >= OVERHEAD_LEVEL_NO_PROBES;
+}
+
+bool overhead_log_detail(void) {
+    return level < OVERHEAD_LEVEL_QUIET;
+}
+
+void overhead_report(void) {
+    log_message("Overhead: %.2f%% of one core (smoothed %.2f%%, budget %.2f%%), cycle %.2f ms, "
+                "%llu syscalls, level %d, over budget in %lu of %lu cycles",
+                cpu_pct, smoothed_pct < 0 ? 0 : smoothed_pct, budget_pct, cycle_ms,
+                cycle_syscalls, level, over_budget_cycles, cycles);
+}
@@ -0,0 +1,304 @@
+#include "android_scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+
+/*
+ * Next-app predictor
+ *
+ * Focus changes are recorded as transitions between apps (identified by
+ * process name, since pids do not survive a relaunch) in a first-order Markov
+ * table, alongside a per-app histogram of focus arrivals by time of day.
+ *
+ * After each focus change the most likely successor of the new app is scored
+ * as P(next | current) weighted by how typical the current time of day is for
+ * that app. A confident prediction pre-warms the app:
+ *   - not running or cached: its executable and shared libraries (learned from
+ *     /proc/<pid>/maps while it was last seen) are paged in with
+ *     posix_fadvise(POSIX_FADV_WILLNEED)
+ *   - cached: every process of the app is promoted to the background tier,
+ *     and its leader's prewarm_until holds the app out of the cached tier
+ *     for PREDICTOR_HOLD_SECS
+ *
+ * Launch time is measured as the gap between process start and first focus.
+ * Launches are reported separately for pre-warmed and cold apps, so the
+ * effect of pre-warming can be read off directly.
+ */
+
+#define TIME_BLOCKS 6            // 4-hour blocks of the day
+
+typedef struct {
+    char name[64];
+    char exe[256];
+    char libs[PREDICTOR_MAX_LIBS][192];
+    int lib_count;
+    unsigned int hour_counts[TIME_BLOCKS];
+    unsigned int focus_count;
+    time_t last_seen;
+    time_t prewarmed_at;
+    pid_t last_launch_pid;       // Last pid whose launch was already measured
+} PredictedApp;
+
+static PredictedApp apps[PREDICTOR_MAX_APPS];
+static unsigned int transitions[PREDICTOR_MAX_APPS][PREDICTOR_MAX_APPS];
+static int app_count = 0;
+static int current_app = -1;
+static pid_t current_pid = -1;
+static int predicted_app = -1;
+
+// Prediction quality and launch-time statistics
+static unsigned long predictions = 0;
+static unsigned long prediction_hits = 0;
+static unsigned long warm_launches = 0;
+static double warm_launch_ms_total = 0;
+static unsigned long cold_launches = 0;
+static double cold_launch_ms_total = 0;
+
+static int time_block(time_t now) {
+    struct tm tm_now;
+    localtime_r(&now, &tm_now);
+    return tm_now.tm_hour / (24 / TIME_BLOCKS);
+}
+
+static bool read_comm(pid_t pid, char *name, size_t size) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/comm", pid);
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+    bool ok = fgets(name, size, f) != NULL;
+    fclose(f);
+    if (ok) name[strcspn(name, "\n")] = '\0';
+    return ok;
+}
+
+static int find_or_add_app(const char *name, time_t now) {
+    for (int i = 0; i < app_count; i++) {
+        if (strcmp(apps[i].name, name) == 0) return i;
+    }
+
+    int slot = app_count;
+    if (app_count < PREDICTOR_MAX_APPS) {
+        app_count++;
+    } else {
+        // Evict the app seen least recently, along with its transitions
+        slot = 0;
+        for (int i = 1; i < app_count; i++) {
+            if (apps[i].last_seen < apps[slot].last_seen) slot = i;
+        }
+        for (int i = 0; i < PREDICTOR_MAX_APPS; i++) {
+            transitions[slot][i] = 0;
+            transitions[i][slot] = 0;
+        }
+        if (current_app == slot) current_app = -1;
+        if (predicted_app == slot) predicted_app = -1;
+    }
+
+    memset(&apps[slot], 0, sizeof(PredictedApp));
+    strncpy(apps[slot].name, name, sizeof(apps[slot].name) - 1);
+    apps[slot].last_seen = now;
+    return slot;
+}
+
+// Remember the executable and libraries so the app can be warmed when not running
+static void learn_app_files(PredictedApp *app, pid_t pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/exe", pid);
+    ssize_t len = readlink(path, app->exe, sizeof(app->exe) - 1);
+    app->exe[len > 0 ? len : 0] = '\0';
+
+    snprintf(path, sizeof(path), "/proc/%d/maps", pid);
+    FILE *f = fopen(path, "r");
+    if (!f) return;
+
+    app->lib_count = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), f) && app->lib_count < PREDICTOR_MAX_LIBS) {
+        char *file = strchr(line, '/');
+        if (!file || !strstr(file, ".so")) continue;
+        file[strcspn(file, "\n")] = '\0';
+
+        // maps lists each library once per segment
+        bool seen = false;
+        for (int i = 0; i < app->lib_count && !seen; i++) {
+            seen = strcmp(app->libs[i], file) == 0;
+        }
+        if (!seen) {
+            strncpy(app->libs[app->lib_count], file, sizeof(app->libs[0]) - 1);
+            app->libs[app->lib_count][sizeof(app->libs[0]) - 1] = '\0';
+            app->lib_count++;
+        }
+    }
+    fclose(f);
+}
+
+static void fadvise_willneed(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    close(fd);
+}
+
+static void prewarm_app(int index, time_t now) {
+    PredictedApp *app = &apps[index];
+    if (app->prewarmed_at && now - app->prewarmed_at < PREDICTOR_COOLDOWN_SECS) return;
+
+    // A matching comm may be any member; the pre-warm belongs to the whole app
+    TrackedProcess *running = NULL;
+    for (int i = 0; i < process_count; i++) {
+        if (strcmp(processes[i].name, app->name) == 0) {
+            running = &processes[i];
+            break;
+        }
+    }
+    TrackedProcess *members[MAX_PROCESSES];
+    int member_count = 0;
+    if (running) {
+        if (running->app_id > 0) member_count = get_app_members(running->app_id, members, MAX_PROCESSES);
+        if (member_count == 0) {
+            members[0] = running;
+            member_count = 1;
+        }
+        for (int i = 0; i < member_count; i++) {
+            if (members[i]->pid == running->app_id) running = members[i];
+        }
+    }
+
+    // Apps that are already in a live tier need no help
+    if (running && running->state != PROCESS_STATE_CACHED) return;
+
+    int warmed = 0;
+    if (app->exe[0]) {
+        fadvise_willneed(app->exe);
+        warmed++;
+    }
+    for (int i = 0; i < app->lib_count; i++) {
+        fadvise_willneed(app->libs[i]);
+        warmed++;
+    }
+
+    // decide_app_state() holds the app by its members' latest prewarm_until,
+    // so setting it on the leader covers renderers and helpers too
+    if (running) {
+        running->prewarm_until = now + PREDICTOR_HOLD_SECS;
+        for (int i = 0; i < member_count; i++) {
+            apply_process_state(members[i], PROCESS_STATE_BACKGROUND, members[i]->importance_score);
+        }
+    }
+
+    app->prewarmed_at = now;
+    if (running) {
+        log_message("Predictor: pre-warmed [%s] (%d files), promoted app %d with %d processes out of cached",
+                    app->name, warmed, running->pid, member_count);
+    } else {
+        log_message("Predictor: pre-warmed [%s] (%d files)", app->name, warmed);
+    }
+}
+
+static double process_age_ms(pid_t pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    char buf[1024];
+    size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[len] = '\0';
+
+    unsigned long long start_ticks;
+    char *name_end = strrchr(buf, ')');
+    if (!name_end || sscanf(name_end + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %llu",
+                            &start_ticks) != 1) {
+        return -1;
+    }
+
+    double uptime;
+    f = fopen("/proc/uptime", "r");
+    if (!f) return -1;
+    int matched = fscanf(f, "%lf", &uptime);
+    fclose(f);
+    if (matched != 1) return -1;
+
+    return (uptime - (double)start_ticks / sysconf(_SC_CLK_TCK)) * 1000.0;
+}
+
+static void record_launch(PredictedApp *app, pid_t pid, time_t now) {
+    if (app->last_launch_pid == pid) return;
+    double age_ms = process_age_ms(pid);
+    if (age_ms < 0 || age_ms > PREDICTOR_LAUNCH_WINDOW * 1000.0) return;
+    app->last_launch_pid = pid;
+
+    // Warm only if the pre-warm happened shortly before this process started
+    bool warm = app->prewarmed_at && (now - app->prewarmed_at) * 1000.0 < age_ms + PREDICTOR_HOLD_SECS * 1000.0;
+    if (warm) {
+        warm_launches++;
+        warm_launch_ms_total += age_ms;
+    } else {
+        cold_launches++;
+        cold_launch_ms_total += age_ms;
+    }
+    log_message("Predictor: [%s] launched in %.0f ms (%s)", app->name, age_ms, warm ? "pre-warmed" : "cold");
+}
+
+static int predict_next(int from, time_t now) {
+    unsigned int row_total = 0;
+    for (int j = 0; j < app_count; j++) row_total += transitions[from][j];
+    if (row_total < PREDICTOR_MIN_SAMPLES) return -1;
+
+    int block = time_block(now);
+    int best = -1;
+    double best_score = 0;
+    for (int j = 0; j < app_count; j++) {
+        if (j == from || transitions[from][j] == 0) continue;
+
+        // Share of this app's focus arrivals in the current block, 1.0 = uniform
+        double time_weight = (apps[j].hour_counts[block] + 1.0) * TIME_BLOCKS / (apps[j].focus_count + TIME_BLOCKS);
+        if (time_weight > 2.0) time_weight = 2.0;
+
+        double score = ((double)transitions[from][j] / row_total) * (0.5 + 0.5 * time_weight);
+        if (score > best_score) {
+            best_score = score;
+            best = j;
+        }
+    }
+    return (best_score >= PREDICTOR_THRESHOLD) ? best : -1;
+}
+
+void predictor_observe_focus(pid_t focused_pid, time_t now) {
+    if (focused_pid <= 0 || focused_pid == current_pid) return;
+
+    char name[64];
+    if (!read_comm(focused_pid, name, sizeof(name))) return;
+
+    int app = find_or_add_app(name, now);
+    current_pid = focused_pid;
+    apps[app].last_seen = now;
+    learn_app_files(&apps[app], focused_pid);
+    record_launch(&apps[app], focused_pid, now);
+
+    // A focus change within the same app (e.g. a second window) is not a transition
+    if (app == current_app) return;
+
+    if (predicted_app != -1 && predicted_app == app) prediction_hits++;
+
+    apps[app].hour_counts[time_block(now)]++;
+    apps[app].focus_count++;
+    if (current_app != -1) transitions[current_app][app]++;
+    current_app = app;
+
+    predicted_app = predict_next(app, now);
+    if (predicted_app != -1) {
+        predictions++;
+        prewarm_app(predicted_app, now);
+    }
+}
+
+void predictor_report(void) {
+    log_message("Predictor: %d apps, %lu predictions, %lu hits (%.0f%%)", app_count, predictions, prediction_hits,
+                predictions ? 100.0 * prediction_hits / predictions : 0.0);
+    log_message("Predictor: launch time pre-warmed %.0f ms avg over %lu, cold %.0f ms avg over %lu",
+                warm_launches ? warm_launch_ms_total / warm_launches : 0.0, warm_launches,
+                cold_launches ? cold_launch_ms_total / cold_launches : 0.0, cold_launches);
+}
@@ -9,6 +9,8 @@
 extern "C" {
 #endif
 
+struct pollfd;
+
 // Process priority levels
 #define PRIORITY_FOREGROUND 0    // Visible activities
 #define PRIORITY_VISIBLE 1       // Visible but not in focus
@@ -25,19 +27,136 @@ typedef enum {
     PROCESS_STATE_CACHED         // In memory but inactive
 } ProcessState;
 
+#define PROCESS_STATE_COUNT 5
+
 // Monitoring configuration
 #define MONITOR_INTERVAL 2
 #define CPU_HISTORY_SIZE 10
 #define MEM_HISTORY_SIZE 10
 #define MAX_PROCESSES 128
-#define LOW_MEMORY_THRESHOLD 15  // 15% available memory threshold
+#define LOW_MEMORY_THRESHOLD 15  // 15% available memory threshold (MemAvailable)
+#define MEMORY_PRESSURE_PSI_PCT 10.0  // System memory "some" avg10 that counts as pressure
+#define PSS_REFRESH_SECS 30      // Minimum age before re-reading smaps_rollup
+#define ASOUND_ROOT "/proc/asound"
+#define MAX_AUDIO_OWNERS 32
+#define MAX_DRM_FDS 8
+#define GPU_FD_REFRESH_SECS 30   // Minimum age before re-walking a process's fds for DRM
+#define GPU_BUSY_PERCENT 1.0     // Engine utilisation that counts as GPU activity
+#define MANIFEST_MAX_ENTRIES 32
+#define MANIFEST_MAX_ARGS 32
+#define ATTACH_MAX_WORKERS 8     // Upper bound on startup scan threads
+#define PF_KTHREAD_FLAG 0x00200000  // PF_KTHREAD bit in /proc/<pid>/stat flags
 
 // cgroup paths
+#define CGROUP_ROOT "/sys/fs/cgroup"
 #define CGROUP_FOREGROUND "/sys/fs/cgroup/foreground"
 #define CGROUP_VISIBLE "/sys/fs/cgroup/visible"
 #define CGROUP_SERVICE "/sys/fs/cgroup/service" 
 #define CGROUP_BACKGROUND "/sys/fs/cgroup/background"
 #define CGROUP_CACHED "/sys/fs/cgroup/cached"
+#define APP_CGROUP_PREFIX "app-"      // Per-app child of a tier: <tier>/app-<leader pid>
+#define LAUNCH_CGROUP "launch"        // Tier child holding launched processes until their first decision
+
+// cgroup v2 capabilities found at startup (android_cgroup.cpp)
+#define CGROUP_CAP_TIERS 0x01        // Unified hierarchy mounted, tier cgroups created
+#define CGROUP_CAP_CPU 0x02          // cpu.max on tiers, cpu.weight on apps
+#define CGROUP_CAP_MEMORY 0x04       // memory.* on tiers and apps
+#define CGROUP_CAP_IO 0x08           // io.* on tiers and apps
+#define CGROUP_CAP_CPUSET 0x10       // cpuset.cpus on tiers (thermal caps)
+#define CGROUP_CAP_UCLAMP 0x20       // cpu.uclamp.min/max on tiers (CONFIG_UCLAMP_TASK_GROUP)
+#define CGROUP_CAP_SWAP 0x40         // memory.swap.* on tiers
+#define CGROUP_CAP_ZSWAP 0x80        // memory.zswap.* on tiers
+#define CGROUP_CAP_RECLAIM 0x100     // memory.reclaim on tiers (proactive reclaim)
+#define CGROUP_CAP_KILL 0x200        // cgroup.kill (Linux 5.14+)
+
+// Focus providers (android_focus.cpp)
+#define X11_LIBRARY "libX11.so.6"
+#define FOCUS_SOCKET_PATH "/run/android_scheduler/focus.sock"
+#define MAX_CLIENT_WINDOWS 64    // Top-level windows tracked for visibility
+#define FOCUS_X11_RETRY_SECS 10  // Reconnect interval after the X connection is lost
+
+// Self-overhead governor (android_overhead.cpp)
+#define OVERHEAD_BUDGET_PCT 1.0          // Default CPU budget, % of one core
+#define OVERHEAD_FILE "/run/android_scheduler/overhead"
+#define OVERHEAD_CACHED_SAMPLE_SECS 30   // Cached sampling interval while degraded
+#define OVERHEAD_RELAX_CYCLES 10         // Calm cycles before a degradation level is released
+#define OVERHEAD_LEVEL_NORMAL 0
+#define OVERHEAD_LEVEL_SLOW_CACHED 1     // Cached tier sampled less often
+#define OVERHEAD_LEVEL_NO_PROBES 2       // ...and no fd walks, net or PSS probes
+#define OVERHEAD_LEVEL_QUIET 3           // ...and per-cycle logging shed
+
+// Persisted state (android_state.cpp)
+#define STATE_FILE "/var/lib/android_scheduler/state"
+#define STATE_SAVE_CYCLES 15     // Checkpoint every 15 monitor cycles
+
+// Policy trace record/replay (android_trace.cpp)
+#define REPLAY_MAX_PROCESSES 4096        // Distinct pids tracked during a replay
+#define REPLAY_MAX_REPORTED_DIFFS 50     // Mismatching decisions logged individually
+#define BENCH_DEFAULT_CYCLES 5000        // Synthetic cycles for 'bench'
+#define BENCH_PROCESSES 120              // Synthetic processes per cycle (<= MAX_PROCESSES)
+#define BENCH_APPS 8                     // Synthetic apps that take turns in focus
+
+// Per-cgroup accounting (android_accounting.cpp)
+#define TIER_ACTIVE_CPU_PERCENT 2.0  // Tier CPU share above which cached/background members are sampled
+#define MEMPROT_LOW_PCT 125          // memory.low on foreground/visible, % of the working set
+#define MEMPROT_MIN_PCT 50           // memory.min on foreground, % of the working set
+#define MEMPROT_MAX_RAM_PCT 50       // Upper bound on a tier's protection, % of RAM
+#define MEMPROT_UPDATE_PCT 10        // Rewrite protection only when it moves by more than this
+
+typedef struct {
+    unsigned long long cpu_usage_usec;   // cpu.stat usage_usec
+    long long memory_current;            // memory.current (bytes)
+    unsigned long long memory_anon;      // memory.stat anon
+    unsigned long long memory_file;      // memory.stat file
+    unsigned long long memory_active_file;  // memory.stat active_file
+    unsigned long long events_high;      // memory.events high
+    unsigned long long events_max;       // memory.events max
+    unsigned long long events_oom_kill;  // memory.events oom_kill
+    long long swap_current;              // memory.swap.current (bytes)
+    unsigned long long memory_zswap;     // memory.stat zswap (compressed size)
+    unsigned long long swapins;          // memory.stat pswpin + zswpin
+    unsigned long long memory_stall_usec;  // memory.pressure "some" total
+    bool valid;
+} CgroupStats;
+
+// Per-tier swap and zswap policy (android_swap.cpp)
+#define SWAP_RECLAIM_MIN_BYTES (1LL << 20)  // Smallest proactive reclaim worth a write
+#define SWAP_RECLAIM_MAX_BYTES (64LL << 20) // Bounds the time one write spends reclaiming
+#define SWAP_RECLAIM_PSI_PCT 1.0            // System memory "some" avg10 that starts reclaim
+#define SWAP_RECLAIM_AVAILABLE_PCT 10       // Or MemAvailable below this % of MemTotal
+
+// Thermal-aware throttling (android_thermal.cpp)
+#define MAX_THERMAL_ZONES 16
+#define THERMAL_CPU_PERIOD_US 100000 // cpu.max period used for thermal caps
+#define THERMAL_HYSTERESIS_MC 2000   // Extra headroom needed before relaxing a level
+
+// Input-driven interaction boost (android_input.cpp)
+#define MAX_INPUT_DEVICES 32
+#define INPUT_BOOST_MS 500           // Boost window after the last input event
+#define INPUT_BOOST_CPU_WEIGHT 500   // Foreground cpu.weight while boosted
+#define UCLAMP_BOOST_MIN 50          // Foreground cpu.uclamp.min (%) while boosted
+#define UCLAMP_DECAY_STEP_MS 250     // uclamp.min halves this often after the window
+#define UCLAMP_DECAY_FLOOR 10        // Below this the boost is dropped entirely
+#define UCLAMP_CACHED_MAX 20         // cpu.uclamp.max (%) for the cached tier
+
+// Next-app predictor (android_predictor.cpp)
+#define PREDICTOR_MAX_APPS 32
+#define PREDICTOR_MAX_LIBS 24
+#define PREDICTOR_MIN_SAMPLES 3      // Transitions seen from an app before predicting
+#define PREDICTOR_THRESHOLD 0.3      // Minimum score to act on a prediction
+#define PREDICTOR_HOLD_SECS 30       // How long a pre-warmed app stays out of the cached tier
+#define PREDICTOR_COOLDOWN_SECS 60   // Minimum gap between pre-warms of the same app
+#define PREDICTOR_LAUNCH_WINDOW 30   // A focus within this many seconds of start counts as a launch
+
+// Service classification rules, matched against the systemd cgroup path
+#define SERVICE_RULES_FILE "/etc/android_scheduler/service_rules"
+#define MAX_SERVICE_RULES 32
+
+typedef enum {
+    CGROUP_CLASS_UNKNOWN,        // No rule matched (e.g. non-systemd host)
+    CGROUP_CLASS_SERVICE,        // System or session service unit
+    CGROUP_CLASS_APP             // User application scope
+} CgroupClass;
 
 // Process resource usage history
 typedef struct {
@@ -62,43 +181,188 @@ typedef struct {
     char cgroup_path[256];
     bool is_system_service;
     bool is_playing_audio;
+    bool is_visible;             // Has an on-screen window but not focus (this cycle)
+    long long memory_low;        // memory.low last written to the app's cgroup (leader only)
+    pid_t sid;                   // Session id
+    bool app_scope;              // Started in a systemd app unit (see origin_cgroup)
+    pid_t app_id;                // Pid of the app's leader, see android_apps.cpp
     int requested_priority;
     time_t last_foreground_time;
     int oom_score;
+    bool oom_pending;            // oom_score_adj not yet written to the kernel
+    pid_t ppid;
+    unsigned long long start_time;  // starttime from /proc/<pid>/stat (clock ticks)
+    char origin_cgroup[256];     // systemd cgroup before we moved the process
+    int pidfd;                   // Exit notification fd for launched children, -1 otherwise
+    bool launched;               // Our own child (reaped with waitpid)
+    long memory_limit;           // Per-app memory.max cap in bytes from a manifest, 0 = none
+    int cpu_weight;              // Per-app cpu.weight override from a manifest, 0 = none
+    double launch_ms;            // Time from spawn to successful exec
+    time_t prewarm_until;        // Kept out of the cached tier until then (predicted next app)
+    long pss_kb;                 // Cached Pss from smaps_rollup
+    long swap_kb;                // Cached SwapPss (or Swap) from smaps_rollup
+    time_t pss_sampled_at;       // 0 = never read
+    int drm_fds[MAX_DRM_FDS];    // fds pointing at /dev/dri or /dev/nvidia (cached)
+    int drm_fd_count;
+    time_t drm_fds_checked_at;
+    unsigned long long gpu_busy_ns;  // Summed drm-engine-* busy time at the last sample
+    double gpu_sampled_at_ms;
+    float gpu_percent;
+    bool ksm_merge_any;          // Opted in to KSM merging (from /proc/<pid>/ksm_stat)
+    bool ksm_checked;
+    time_t sampled_at;           // Last full resource sample, 0 = never
 } TrackedProcess;
 
+// Tracked process table (android_module.cpp)
+extern TrackedProcess processes[MAX_PROCESSES];
+extern int process_count;
+extern bool memory_pressure;
+
 // Function declarations
 void log_message(const char *format, ...);
+int write_cgroup_file(const char *cgroup_path, const char *file, const char *value);
 int assign_to_cgroup(const char *cgroup_path, pid_t pid);
 float get_process_cpu_usage(pid_t pid);
 long get_process_memory_usage(pid_t pid);
+int read_smaps_rollup(pid_t pid, long *pss_kb, long *swap_kb);
+long get_process_footprint(TrackedProcess *proc, time_t now);
 pid_t get_focused_window_pid();
+void scan_audio_owners(void);
+bool is_audio_owner(pid_t pid);
 bool is_playing_audio(pid_t pid);
+bool select_focus_provider(const char *name);
+const char *focus_provider_name(void);
+int get_visible_pids(pid_t *pids, int max);
+int open_focus_events(void);
+bool focus_events_pending(void);
+void close_focus_events(void);
+pid_t poll_focus_event(void);
+void focus_fast_path(pid_t focused_pid);
+void wait_for_next_cycle(int interval_ms);
 pid_t get_parent_pid(pid_t pid);
 bool is_using_gpu(pid_t pid);
+int scan_drm_fds(const char *proc_root, pid_t pid, int *fds, int max);
+int read_drm_busy_ns(const char *proc_root, pid_t pid, const int *fds, int count,
+                     unsigned long long *busy_ns);
+float sample_gpu_utilization(TrackedProcess *proc, time_t now);
+void set_gpu_proc_root(const char *root);
 bool check_disk_activity(pid_t pid);
 bool is_using_network(pid_t pid);
 bool check_memory_pressure();
 bool is_system_service(pid_t pid);
+bool cmdline_is_system_service(const char *cmdline, size_t len);
+void load_service_rules(const char *path);
+int read_origin_cgroup(pid_t pid, char *buf, size_t size);
+CgroupClass classify_cgroup_path(const char *cgroup);
+bool read_process_snapshot(TrackedProcess *proc, pid_t pid, bool *is_kthread);
 void set_oom_score(pid_t pid, int score);
-void update_resource_history(TrackedProcess *proc);
+void update_resource_history(TrackedProcess *proc, time_t now);
 float calculate_average_cpu(TrackedProcess *proc);
 long calculate_average_memory(TrackedProcess *proc);
-float calculate_importance_score(TrackedProcess *proc, pid_t focused_pid);
+float calculate_importance_score(TrackedProcess *proc, pid_t focused_pid, time_t now);
+float calculate_importance_score_at(TrackedProcess *proc, pid_t focused_pid, time_t now);
 int change_process_priority(pid_t pid, int requested_priority);
 const char* get_cgroup_for_state(ProcessState state);
+const char* get_state_name(ProcessState state);
+bool parse_state_name(const char *name, ProcessState *state);
 int get_oom_score_for_state(ProcessState state);
+ProcessState decide_state(float importance_score, int requested_priority, bool is_visible,
+                          time_t prewarm_until, time_t now);
+ProcessState decide_process_state(TrackedProcess *proc, float importance_score, time_t now);
+void apply_process_state(TrackedProcess *proc, ProcessState new_state, float importance_score);
+TrackedProcess *find_tracked_process(pid_t pid);
+int app_unit_length(const char *cgroup);
+void update_app_groups(void);
+int get_app_members(pid_t app_id, TrackedProcess **members, int max);
+ProcessState decide_app_state(TrackedProcess *const *members, int count, time_t now, float *app_score);
+int kill_idle_cached_app(pid_t app_id, time_t now);
+void app_cgroup_path(ProcessState state, pid_t app_id, char *buf, size_t size);
+bool is_app_cgroup(const char *path);
+int enter_app_cgroup(const char *path, pid_t pid);
+int migrate_app_cgroup(const char *from, const char *to);
+void remove_app_cgroup(const char *path);
+int prune_app_cgroups(void);
 void update_process_state(TrackedProcess *proc, float importance_score);
-void adjust_resource_controls(TrackedProcess *proc);
+void adjust_resource_controls(TrackedProcess *const *members, int count);
 void update_lru_list();
 void monitor_all_processes();
 void initialize_process(TrackedProcess *proc, pid_t pid, const char *initial_group);
-void launch_and_track_process(const char *group, char *const argv[]);
+pid_t spawn_into_cgroup(const char *cgroup_path, char *const argv[], int *pidfd_out);
+pid_t launch_and_track_process(const char *group, char *const argv[]);
+int launch_manifest(const char *path);
 void setup_cgroups();
+bool cgroup_capable(int caps);
+void cgroup_report(void);
 void attach_to_existing_processes();
 bool are_processes_related(pid_t pid1, pid_t pid2);
 bool check_ipc_connections(pid_t pid1, pid_t pid2);
+bool shutdown_requested(void);
+void print_debug_report(void);
 void handle_signal(int sig);
+void release_placements();
+int save_state(bool placements_kept, bool sync);
+int restore_state(void);
+void close_state(void);
+int read_cgroup_stats(const char *cgroup_path, CgroupStats *stats);
+void update_tier_accounting(void);
+const CgroupStats *get_tier_stats(ProcessState state);
+float get_tier_cpu_percent(ProcessState state);
+bool tier_under_memory_pressure(ProcessState state);
+double system_memory_stall_pct(void);
+int system_memory_available_pct(void);
+long long app_memory_footprint(const TrackedProcess *leader);
+void tier_accounting_report(void);
+void update_tier_protection(void);
+void setup_swap_policy(void);
+void update_swap_policy(void);
+void swap_report(void);
+void setup_ksm(void);
+void ksm_opt_in_child(void);
+void update_ksm(void);
+void close_ksm(void);
+void ksm_report(void);
+void setup_overhead_governor(void);
+void close_overhead_governor(void);
+void overhead_discard_children(void);
+void overhead_begin_cycle(void);
+void overhead_end_cycle(void);
+int overhead_level(void);
+bool overhead_shed_probes(void);
+bool overhead_log_detail(void);
+void overhead_report(void);
+void update_app_protection(TrackedProcess *leader);
+bool should_sample_process(TrackedProcess *proc, pid_t focused_pid, time_t now);
+void set_thermal_root(const char *root);
+int parse_cpu_list(const char *list, int *cpus, int max);
+void thermal_cpuset(int level, const int *cpus, int cpu_count, char *buf, size_t size);
+int update_thermal_state(void);
+void close_thermal(void);
+int get_thermal_level(void);
+int get_thermal_headroom_mc(void);
+void thermal_report(void);
+int open_input_devices(void);
+void close_input_devices(void);
+int input_fill_pollfds(struct pollfd *fds, int max);
+bool input_boost_active(void);
+int input_boost_remaining_ms(void);
+void handle_input_ready(struct pollfd *fds, int count);
+void expire_input_boost(void);
+void init_uclamp(void);
+void init_app_uclamp(const char *cgroup_path);
+void close_uclamp(void);
+void boost_focus_change(pid_t focused_pid);
+void input_report(void);
+void predictor_observe_focus(pid_t focused_pid, time_t now);
+void predictor_report(void);
+int trace_open(const char *path);
+void trace_close(void);
+void trace_begin_cycle(time_t now, pid_t focused_pid, bool pressure);
+void trace_begin_focus(time_t now, pid_t focused_pid);
+void trace_record_process(const TrackedProcess *proc, ProcessState prev_state, bool sampled, time_t now);
+void trace_end_cycle(void);
+int replay_trace(const char *path);
+int write_synthetic_trace(const char *path, int cycles);
+int run_policy_benchmark(int cycles);
 void setup_priority_change_service();
 void check_priority_requests();
 
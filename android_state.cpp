@@ -0,0 +1,292 @@
+#include "android_scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * Persisted monitor state
+ *
+ * The tracked process table (history rings, last_active, last_foreground_time,
+ * tiers, requested priorities) is mirrored into an mmap'd file on shutdown and
+ * every STATE_SAVE_CYCLES monitor cycles. On start the file is read back and
+ * each record is accepted only if the pid still exists with the same
+ * starttime, so a recycled pid never inherits another process's history.
+ *
+ * A handover shutdown (SIGUSR2) leaves every process in its tier cgroup with
+ * its oom_score_adj, so the next instance picks up without moving anything.
+ *
+ * Records are an explicit StateRecord with fixed-width fields, not a copy of
+ * TrackedProcess, so the file survives upgrades that change the in-memory
+ * table. New fields are appended to the record, and a reader steps through
+ * the file by the writer's record_size and reads the fields it knows about;
+ * fields an older writer did not have read as zero. The file is only ever
+ * grown, so a newer writer's larger file is read before it is rewritten.
+ * STATE_VERSION is bumped only when an existing field changes meaning.
+ */
+
+#define STATE_MAGIC "ASCHED02"
+#define STATE_VERSION 1
+#define STATE_HISTORY_SIZE 10        // History slots in a record, independent of the ring sizes
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;        // sizeof(StateRecord) of the writer
+    uint32_t count;
+    uint32_t placements_kept;    // Written by a handover shutdown
+    int64_t saved_at;
+} StateFileHeader;
+
+typedef struct {
+    int32_t pid;
+    int32_t state;
+    uint64_t start_time;         // Identifies the process together with pid
+    int64_t last_active;
+    int64_t last_foreground_time;
+    int64_t prewarm_until;
+    int64_t memory_limit;
+    float importance_score;
+    int32_t requested_priority;
+    int32_t oom_score;
+    int32_t cpu_weight;
+    uint8_t is_system_service;
+    uint8_t reserved[7];
+    char cgroup_path[256];
+    char origin_cgroup[256];
+
+    // ResourceHistory
+    float cpu_usage[STATE_HISTORY_SIZE];
+    int32_t cpu_index;
+    int32_t mem_index;
+    int64_t memory_usage[STATE_HISTORY_SIZE];
+    int64_t last_network_activity;
+    int64_t last_disk_activity;
+    int64_t last_gpu_activity;
+} StateRecord;
+
+#define STATE_FILE_SIZE (sizeof(StateFileHeader) + MAX_PROCESSES * sizeof(StateRecord))
+
+static void *state_map = NULL;
+static size_t state_map_size = 0;    // At least STATE_FILE_SIZE; larger for a newer writer's file
+
+static int map_state_file(void) {
+    if (state_map) return 0;
+
+    // Create the parent directory on first use
+    char dir[256];
+    strncpy(dir, STATE_FILE, sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = '\0';
+    char *slash = strrchr(dir, '/');
+    if (slash && slash != dir) {
+        *slash = '\0';
+        mkdir(dir, 0755);
+    }
+
+    int fd = open(STATE_FILE, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        log_message("Failed to open state file %s: %s", STATE_FILE, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        log_message("Failed to stat state file %s: %s", STATE_FILE, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    size_t size = STATE_FILE_SIZE;
+    if ((size_t)st.st_size > size) {
+        size = st.st_size;
+    } else if ((size_t)st.st_size < size && ftruncate(fd, size) == -1) {
+        log_message("Failed to size state file %s: %s", STATE_FILE, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        log_message("Failed to map state file %s: %s", STATE_FILE, strerror(errno));
+        return -1;
+    }
+    state_map = map;
+    state_map_size = size;
+    return 0;
+}
+
+static void copy_string(char *dst, size_t dst_size, const char *src, size_t src_size) {
+    size_t len = strnlen(src, src_size);
+    if (len > dst_size - 1) len = dst_size - 1;
+    memcpy(dst, src, len);
+    memset(dst + len, 0, dst_size - len);
+}
+
+static void fill_record(StateRecord *record, const TrackedProcess *proc) {
+    memset(record, 0, sizeof(*record));
+    record->pid = proc->pid;
+    record->state = proc->state;
+    record->start_time = proc->start_time;
+    record->last_active = proc->last_active;
+    record->last_foreground_time = proc->last_foreground_time;
+    record->prewarm_until = proc->prewarm_until;
+    record->memory_limit = proc->memory_limit;
+    record->importance_score = proc->importance_score;
+    record->requested_priority = proc->requested_priority;
+    record->oom_score = proc->oom_score;
+    record->cpu_weight = proc->cpu_weight;
+    record->is_system_service = proc->is_system_service;
+    copy_string(record->cgroup_path, sizeof(record->cgroup_path), proc->cgroup_path, sizeof(proc->cgroup_path));
+    copy_string(record->origin_cgroup, sizeof(record->origin_cgroup), proc->origin_cgroup, sizeof(proc->origin_cgroup));
+
+    const ResourceHistory *history = &proc->resource_history;
+    for (int i = 0; i < STATE_HISTORY_SIZE && i < CPU_HISTORY_SIZE; i++) record->cpu_usage[i] = history->cpu_usage[i];
+    for (int i = 0; i < STATE_HISTORY_SIZE && i < MEM_HISTORY_SIZE; i++) record->memory_usage[i] = history->memory_usage[i];
+    record->cpu_index = history->cpu_index;
+    record->mem_index = history->mem_index;
+    record->last_network_activity = history->last_network_activity;
+    record->last_disk_activity = history->last_disk_activity;
+    record->last_gpu_activity = history->last_gpu_activity;
+}
+
+int save_state(bool placements_kept, bool sync) {
+    if (map_state_file() != 0) return -1;
+
+    StateFileHeader *header = (StateFileHeader *)state_map;
+    StateRecord *records = (StateRecord *)((char *)state_map + sizeof(StateFileHeader));
+
+    // Invalidate first so a crash mid-copy leaves an empty rather than torn file
+    header->count = 0;
+    for (int i = 0; i < process_count; i++) {
+        fill_record(&records[i], &processes[i]);
+    }
+
+    memcpy(header->magic, STATE_MAGIC, sizeof(header->magic));
+    header->version = STATE_VERSION;
+    header->record_size = sizeof(StateRecord);
+    header->saved_at = time(NULL);
+    header->placements_kept = placements_kept ? 1 : 0;
+    header->count = process_count;
+
+    msync(state_map, state_map_size, sync ? MS_SYNC : MS_ASYNC);
+    return 0;
+}
+
+void close_state(void) {
+    if (state_map) {
+        munmap(state_map, state_map_size);
+        state_map = NULL;
+        state_map_size = 0;
+    }
+}
+
+// Carry learned fields over from a saved record onto a freshly attached entry
+static void merge_saved_record(TrackedProcess *proc, const StateRecord *saved) {
+    if (saved->state >= 0 && saved->state < PROCESS_STATE_COUNT) proc->state = (ProcessState)saved->state;
+    proc->last_active = saved->last_active;
+    proc->last_foreground_time = saved->last_foreground_time;
+    proc->prewarm_until = saved->prewarm_until;
+    proc->importance_score = saved->importance_score;
+    proc->requested_priority = saved->requested_priority;
+    proc->oom_score = saved->oom_score;
+    proc->memory_limit = saved->memory_limit;
+    proc->cpu_weight = saved->cpu_weight;
+    copy_string(proc->cgroup_path, sizeof(proc->cgroup_path), saved->cgroup_path, sizeof(saved->cgroup_path));
+
+    ResourceHistory *history = &proc->resource_history;
+    for (int i = 0; i < STATE_HISTORY_SIZE && i < CPU_HISTORY_SIZE; i++) history->cpu_usage[i] = saved->cpu_usage[i];
+    for (int i = 0; i < STATE_HISTORY_SIZE && i < MEM_HISTORY_SIZE; i++) history->memory_usage[i] = saved->memory_usage[i];
+    history->cpu_index = (saved->cpu_index >= 0) ? saved->cpu_index % CPU_HISTORY_SIZE : 0;
+    history->mem_index = (saved->mem_index >= 0) ? saved->mem_index % MEM_HISTORY_SIZE : 0;
+    history->last_network_activity = saved->last_network_activity;
+    history->last_disk_activity = saved->last_disk_activity;
+    history->last_gpu_activity = saved->last_gpu_activity;
+
+    // After our tier moves /proc/<pid>/cgroup no longer shows the systemd unit
+    copy_string(proc->origin_cgroup, sizeof(proc->origin_cgroup), saved->origin_cgroup, sizeof(saved->origin_cgroup));
+    proc->is_system_service = saved->is_system_service;
+}
+
+int restore_state(void) {
+    if (access(STATE_FILE, F_OK) != 0) {
+        log_message("No saved state, starting cold");
+        return 0;
+    }
+    if (map_state_file() != 0) return -1;
+
+    const StateFileHeader *header = (const StateFileHeader *)state_map;
+    const char *records = (const char *)state_map + sizeof(StateFileHeader);
+
+    // A newer writer may have appended fields and an older one may lack some;
+    // either way the common prefix is valid
+    if (memcmp(header->magic, STATE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != STATE_VERSION || header->record_size == 0 ||
+        header->count > MAX_PROCESSES ||
+        sizeof(StateFileHeader) + (size_t)header->count * header->record_size > state_map_size) {
+        log_message("Ignoring incompatible state file %s", STATE_FILE);
+        return 0;
+    }
+
+    size_t known = header->record_size < sizeof(StateRecord) ? header->record_size : sizeof(StateRecord);
+    int merged = 0, adopted = 0, stale = 0;
+    for (uint32_t i = 0; i < header->count; i++) {
+        StateRecord saved_copy;
+        memset(&saved_copy, 0, sizeof(saved_copy));
+        memcpy(&saved_copy, records + (size_t)i * header->record_size, known);
+        const StateRecord *saved = &saved_copy;
+
+        // Only the same process (pid and starttime) inherits the saved history
+        TrackedProcess current;
+        bool is_kthread;
+        memset(&current, 0, sizeof(current));
+        if (!read_process_snapshot(&current, saved->pid, &is_kthread) ||
+            current.start_time != saved->start_time) {
+            stale++;
+            continue;
+        }
+
+        TrackedProcess *proc = NULL;
+        for (int j = 0; j < process_count; j++) {
+            if (processes[j].pid == saved->pid) {
+                proc = &processes[j];
+                break;
+            }
+        }
+        if (proc) {
+            merged++;
+        } else if (process_count < MAX_PROCESSES) {
+            // Adopt processes the previous instance was tracking
+            proc = &processes[process_count++];
+            *proc = current;
+            proc->pid = saved->pid;
+            proc->pidfd = -1;
+            proc->launched = false;
+            adopted++;
+        } else {
+            break;
+        }
+        merge_saved_record(proc, saved);
+
+        // Without a handover the old instance moved everything back to the root cgroup
+        if (header->placements_kept) {
+            proc->oom_pending = false;
+        } else {
+            if (is_app_cgroup(proc->cgroup_path)) {
+                enter_app_cgroup(proc->cgroup_path, proc->pid);
+            } else {
+                assign_to_cgroup(proc->cgroup_path, proc->pid);
+            }
+            proc->oom_pending = true;
+        }
+    }
+
+    log_message("Restored state saved %lds ago: %d merged, %d adopted, %d stale%s",
+                (long)(time(NULL) - header->saved_at), merged, adopted, stale,
+                header->placements_kept ? " (handover, placements kept)" : "");
+    return merged + adopted;
+}
@@ -0,0 +1,140 @@
+#include "android_scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+/*
+ * Per-tier swap and zswap policy
+ *
+ * Swap is an alternative to killing: a cached app whose pages sit compressed
+ * in zswap (or zram) restores far faster than a cold start. Each tier gets a
+ * memory.swap.max / memory.zswap.max pair. Foreground and visible apps may
+ * not swap at all, so anything on screen never waits on a swap-in. The lower
+ * tiers may swap freely. Under real memory pressure the background and cached
+ * tiers are also reclaimed proactively through memory.reclaim, so their anon
+ * pages are compressed before the kernel has to reclaim from the tiers that
+ * matter. Pressure here means tasks stalling on memory (system PSI "some"
+ * avg10 of SWAP_RECLAIM_PSI_PCT) or MemAvailable below
+ * SWAP_RECLAIM_AVAILABLE_PCT. Free memory is no guide: a full page cache
+ * keeps it low on any busy desktop, and reclaiming then would drain the very
+ * caches this is meant to keep.
+ *
+ * Swap-in cost is tracked per tier from memory.stat (pswpin + zswpin) and
+ * memory.pressure. The PSI "some" stall time accrued in cycles that saw
+ * swap-ins, divided by those swap-ins, estimates the latency of one swap-in.
+ * PSI also counts other memory stalls, so this is an upper bound.
+ */
+
+typedef struct {
+    const char *swap_max;        // memory.swap.max
+    const char *zswap_max;       // memory.zswap.max
+    int reclaim_pct;             // Proactive reclaim per cycle under pressure, % of memory.current
+} SwapPolicy;
+
+static const SwapPolicy swap_policy[PROCESS_STATE_COUNT] = {
+    { "0",   "0",   0 },         // Foreground: never swapped
+    { "0",   "0",   0 },         // Visible
+    { "max", "max", 0 },         // Service
+    { "max", "max", 2 },         // Background
+    { "max", "max", 5 },         // Cached
+};
+
+typedef struct {
+    unsigned long long last_swapins;
+    unsigned long long last_stall_usec;
+    bool primed;
+    unsigned long long swapins;          // Swap-ins seen since startup
+    unsigned long long stall_usec;       // Memory stall in cycles with swap-ins
+    long long reclaimed;                 // Bytes requested through memory.reclaim
+} SwapAccount;
+
+static SwapAccount swap_accounts[PROCESS_STATE_COUNT];
+
+void setup_swap_policy(void) {
+    if (!cgroup_capable(CGROUP_CAP_SWAP)) {
+        log_message("Swap policy: memory.swap.max not available");
+        return;
+    }
+
+    for (int state = 0; state < PROCESS_STATE_COUNT; state++) {
+        const char *tier = get_cgroup_for_state((ProcessState)state);
+        write_cgroup_file(tier, "memory.swap.max", swap_policy[state].swap_max);
+        if (cgroup_capable(CGROUP_CAP_ZSWAP)) {
+            write_cgroup_file(tier, "memory.zswap.max", swap_policy[state].zswap_max);
+        }
+    }
+    log_message("Swap policy: foreground and visible swap disabled%s%s",
+                cgroup_capable(CGROUP_CAP_ZSWAP) ? ", zswap per tier" : "",
+                cgroup_capable(CGROUP_CAP_RECLAIM) ? ", proactive reclaim under pressure" : "");
+}
+
+static void account_swapins(ProcessState state) {
+    const CgroupStats *stats = get_tier_stats(state);
+    SwapAccount *account = &swap_accounts[state];
+    if (!stats->valid) return;
+
+    if (account->primed && stats->swapins >= account->last_swapins &&
+        stats->memory_stall_usec >= account->last_stall_usec) {
+        unsigned long long swapins = stats->swapins - account->last_swapins;
+        if (swapins > 0) {
+            account->swapins += swapins;
+            account->stall_usec += stats->memory_stall_usec - account->last_stall_usec;
+        }
+    }
+    account->last_swapins = stats->swapins;
+    account->last_stall_usec = stats->memory_stall_usec;
+    account->primed = true;
+}
+
+static void reclaim_tier(ProcessState state) {
+    const CgroupStats *stats = get_tier_stats(state);
+    long long bytes = stats->memory_current / 100 * swap_policy[state].reclaim_pct;
+    if (bytes > SWAP_RECLAIM_MAX_BYTES) bytes = SWAP_RECLAIM_MAX_BYTES;
+    if (bytes < SWAP_RECLAIM_MIN_BYTES) return;
+
+    // EAGAIN only means less than the full amount could be reclaimed
+    char value[32];
+    snprintf(value, sizeof(value), "%lld", bytes);
+    if (write_cgroup_file(get_cgroup_for_state(state), "memory.reclaim", value) != 0 && errno != EAGAIN) {
+        log_message("Proactive reclaim of %s failed: %s", get_state_name(state), strerror(errno));
+        return;
+    }
+    swap_accounts[state].reclaimed += bytes;
+}
+
+static bool reclaim_wanted(void) {
+    if (system_memory_stall_pct() >= SWAP_RECLAIM_PSI_PCT) return true;
+    int available = system_memory_available_pct();
+    return available >= 0 && available < SWAP_RECLAIM_AVAILABLE_PCT;
+}
+
+// Runs after update_tier_accounting() so the tier figures are current
+void update_swap_policy(void) {
+    if (!cgroup_capable(CGROUP_CAP_MEMORY)) return;
+
+    bool pressure = cgroup_capable(CGROUP_CAP_RECLAIM) && reclaim_wanted();
+
+    for (int state = 0; state < PROCESS_STATE_COUNT; state++) {
+        account_swapins((ProcessState)state);
+        if (pressure && swap_policy[state].reclaim_pct > 0) {
+            reclaim_tier((ProcessState)state);
+        }
+    }
+}
+
+void swap_report(void) {
+    for (int state = 0; state < PROCESS_STATE_COUNT; state++) {
+        const CgroupStats *stats = get_tier_stats((ProcessState)state);
+        const SwapAccount *account = &swap_accounts[state];
+        if (!stats->valid) continue;
+
+        log_message("Swap %-10s: swap=%lldMB zswap=%lluMB swap-ins=%llu (~%.2f ms each) reclaimed=%lldMB",
+                    get_state_name((ProcessState)state),
+                    stats->swap_current / (1024 * 1024), stats->memory_zswap / (1024 * 1024),
+                    account->swapins,
+                    account->swapins ? account->stall_usec / 1000.0 / account->swapins : 0.0,
+                    account->reclaimed / (1024 * 1024));
+    }
+}
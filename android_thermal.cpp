@@ -0,0 +1,296 @@
+#include "android_scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+
+/*
+ * Thermal-aware tier throttling
+ *
+ * Thermal zones are read from <thermal root>/thermal_zone*. The root defaults
+ * to /sys/class/thermal and can be pointed at a fabricated tree with
+ * ANDROID_SCHED_THERMAL_ROOT (or set_thermal_root()) for testing;
+ * test_thermal.sh does that.
+ *
+ * For each zone, the throttling point is its lowest "passive" trip point, or
+ * the lowest "hot"/"critical" one if the zone has no passive trip. Headroom
+ * is the smallest gap between a zone's temperature and its throttling point.
+ * As headroom shrinks, the background and cached tiers are capped
+ * progressively through cpu.max and a smaller cpuset, so the firmware never
+ * has to drop clocks under the foreground app. The cpuset is a prefix of the
+ * root's cpuset.cpus.effective, which need not be contiguous or start at 0.
+ *
+ * The first scan applies its level even if it is 0, which clears caps left
+ * by a previous instance, and close_thermal() lifts the caps at shutdown.
+ */
+
+typedef struct {
+    char path[528];
+    char type[32];
+    int trip_mc;                 // Throttling trip point, millidegrees C
+} ThermalZone;
+
+typedef struct {
+    int headroom_mc;             // Enter this level below this much headroom
+    int background_pct;          // cpu.max for the background tier, % of all CPUs
+    int cached_pct;              // cpu.max for the cached tier, % of all CPUs
+    int cpuset_divisor;          // Low tiers get 1/n of the CPUs, 1 = all
+} ThermalLevel;
+
+static const ThermalLevel thermal_levels[] = {
+    { 0,     100, 100, 1 },      // Level 0: no caps
+    { 15000, 50,  25,  1 },
+    { 10000, 25,  10,  2 },
+    { 5000,  10,  5,   0 }       // 0 = a single CPU
+};
+#define THERMAL_LEVEL_COUNT (int)(sizeof(thermal_levels) / sizeof(thermal_levels[0]))
+
+static char thermal_root[256] = "/sys/class/thermal";
+static bool thermal_root_overridden = false;
+static ThermalZone zones[MAX_THERMAL_ZONES];
+static int zone_count = 0;
+static bool zones_scanned = false;
+static int current_level = 0;
+static bool level_applied = false;
+static int last_headroom_mc = -1;
+static int last_temp_mc = 0;
+static int hottest_zone = -1;
+
+void set_thermal_root(const char *root) {
+    strncpy(thermal_root, root, sizeof(thermal_root) - 1);
+    thermal_root[sizeof(thermal_root) - 1] = '\0';
+    thermal_root_overridden = true;
+    zones_scanned = false;
+    zone_count = 0;
+}
+
+static bool read_int_file(const char *dir, const char *file, int *value) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+    bool ok = fscanf(f, "%d", value) == 1;
+    fclose(f);
+    return ok;
+}
+
+static bool read_word_file(const char *dir, const char *file, char *buf, size_t size) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+    bool ok = fgets(buf, size, f) != NULL;
+    fclose(f);
+    if (ok) buf[strcspn(buf, "\n")] = '\0';
+    return ok;
+}
+
+// Trip points rarely change, so they are read once per scan
+static void scan_thermal_zones(void) {
+    zones_scanned = true;
+    zone_count = 0;
+
+    const char *env_root = getenv("ANDROID_SCHED_THERMAL_ROOT");
+    if (!thermal_root_overridden && env_root && env_root[0]) {
+        strncpy(thermal_root, env_root, sizeof(thermal_root) - 1);
+    }
+
+    DIR *dir = opendir(thermal_root);
+    if (!dir) return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && zone_count < MAX_THERMAL_ZONES) {
+        if (strncmp(entry->d_name, "thermal_zone", 12) != 0) continue;
+
+        ThermalZone *zone = &zones[zone_count];
+        snprintf(zone->path, sizeof(zone->path), "%s/%s", thermal_root, entry->d_name);
+        if (!read_word_file(zone->path, "type", zone->type, sizeof(zone->type))) {
+            strncpy(zone->type, entry->d_name, sizeof(zone->type) - 1);
+        }
+
+        int passive = -1, fallback = -1;
+        for (int trip = 0; trip < 16; trip++) {
+            char file[64], kind[32];
+            int temp;
+            snprintf(file, sizeof(file), "trip_point_%d_temp", trip);
+            if (!read_int_file(zone->path, file, &temp)) break;
+            snprintf(file, sizeof(file), "trip_point_%d_type", trip);
+            if (!read_word_file(zone->path, file, kind, sizeof(kind)) || temp <= 0) continue;
+
+            if (strcmp(kind, "passive") == 0) {
+                if (passive == -1 || temp < passive) passive = temp;
+            } else if (strcmp(kind, "hot") == 0 || strcmp(kind, "critical") == 0) {
+                if (fallback == -1 || temp < fallback) fallback = temp;
+            }
+        }
+        zone->trip_mc = (passive != -1) ? passive : fallback;
+        if (zone->trip_mc > 0) zone_count++;
+    }
+    closedir(dir);
+
+    log_message("Thermal: monitoring %d zones under %s", zone_count, thermal_root);
+}
+
+static void write_cpu_cap(ProcessState state, int pct, long cpus) {
+    if (!cgroup_capable(CGROUP_CAP_CPU)) return;
+    char value[64];
+    if (pct >= 100) {
+        snprintf(value, sizeof(value), "max %d", THERMAL_CPU_PERIOD_US);
+    } else {
+        long quota = (long)THERMAL_CPU_PERIOD_US * cpus * pct / 100;
+        if (quota < 1000) quota = 1000;
+        snprintf(value, sizeof(value), "%ld %d", quota, THERMAL_CPU_PERIOD_US);
+    }
+    write_cgroup_file(get_cgroup_for_state(state), "cpu.max", value);
+}
+
+// Expands a cpu list such as "0-3,8-11"; returns the count
+int parse_cpu_list(const char *list, int *cpus, int max) {
+    char buf[1024];
+    strncpy(buf, list, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    int count = 0;
+    for (char *range = strtok(buf, ",\n"); range && count < max; range = strtok(NULL, ",\n")) {
+        int first, last;
+        int fields = sscanf(range, "%d-%d", &first, &last);
+        if (fields < 1) continue;
+        if (fields == 1) last = first;
+        for (int cpu = first; cpu <= last && count < max; cpu++) cpus[count++] = cpu;
+    }
+    return count;
+}
+
+static int read_effective_cpus(int *cpus, int max) {
+    char path[256], buf[1024];
+    snprintf(path, sizeof(path), "%s/cpuset.cpus.effective", CGROUP_ROOT);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return 0;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) return 0;
+    buf[n] = '\0';
+    return parse_cpu_list(buf, cpus, max);
+}
+
+// Formats the first count CPUs as a cpu list, merging consecutive ids into ranges
+static void format_cpu_list(const int *cpus, int count, char *buf, size_t size) {
+    size_t len = 0;
+    buf[0] = '\0';
+    for (int i = 0; i < count && len < size; ) {
+        int j = i;
+        while (j + 1 < count && cpus[j + 1] == cpus[j] + 1) j++;
+        if (j == i) {
+            len += snprintf(buf + len, size - len, "%s%d", len ? "," : "", cpus[i]);
+        } else {
+            len += snprintf(buf + len, size - len, "%s%d-%d", len ? "," : "", cpus[i], cpus[j]);
+        }
+        i = j + 1;
+    }
+}
+
+// The low tiers' cpuset at a level: a prefix of the effective CPUs, "" for all of them
+void thermal_cpuset(int level, const int *cpus, int cpu_count, char *buf, size_t size) {
+    int divisor = thermal_levels[level].cpuset_divisor;
+    buf[0] = '\0';
+    if (divisor == 1 || cpu_count == 0) return;
+    int count = (divisor == 0) ? 1 : cpu_count / divisor;
+    if (count < 1) count = 1;
+    format_cpu_list(cpus, count, buf, size);
+}
+
+static void write_cpuset(ProcessState state, const char *cpuset) {
+    if (!cgroup_capable(CGROUP_CAP_CPUSET)) return;
+    // An empty cpuset.cpus inherits the parent's CPUs again
+    write_cgroup_file(get_cgroup_for_state(state), "cpuset.cpus", cpuset[0] ? cpuset : "\n");
+}
+
+static void apply_thermal_level(int level) {
+    static int cpu_ids[1024];
+    int cpu_count = read_effective_cpus(cpu_ids, sizeof(cpu_ids) / sizeof(cpu_ids[0]));
+    long cpus = cpu_count > 0 ? cpu_count : sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) cpus = 1;
+    const ThermalLevel *caps = &thermal_levels[level];
+    char cpuset[256];
+    thermal_cpuset(level, cpu_ids, cpu_count, cpuset, sizeof(cpuset));
+
+    write_cpu_cap(PROCESS_STATE_BACKGROUND, caps->background_pct, cpus);
+    write_cpu_cap(PROCESS_STATE_CACHED, caps->cached_pct, cpus);
+    write_cpuset(PROCESS_STATE_BACKGROUND, cpuset);
+    write_cpuset(PROCESS_STATE_CACHED, cpuset);
+    level_applied = true;
+}
+
+int update_thermal_state(void) {
+    if (!zones_scanned) scan_thermal_zones();
+    if (zone_count == 0) {
+        // Still clear caps a previous instance may have left behind
+        if (!level_applied) {
+            log_message("Thermal: no zones to follow, clearing throttle caps");
+            apply_thermal_level(0);
+        }
+        return -1;
+    }
+
+    // Headroom is set by the zone closest to throttling
+    int headroom = 0;
+    bool found = false;
+    for (int i = 0; i < zone_count; i++) {
+        int temp;
+        if (!read_int_file(zones[i].path, "temp", &temp)) continue;
+        int zone_headroom = zones[i].trip_mc - temp;
+        if (!found || zone_headroom < headroom) {
+            found = true;
+            headroom = zone_headroom;
+            last_temp_mc = temp;
+            hottest_zone = i;
+        }
+    }
+    if (!found) return -1;
+    if (headroom < 0) headroom = 0;
+    last_headroom_mc = headroom;
+
+    // Step up as soon as a threshold is crossed, step down only with some margin
+    int level = 0;
+    for (int i = 1; i < THERMAL_LEVEL_COUNT; i++) {
+        int threshold = thermal_levels[i].headroom_mc;
+        if (i <= current_level) threshold += THERMAL_HYSTERESIS_MC;
+        if (headroom < threshold) level = i;
+    }
+
+    if (level != current_level || !level_applied) {
+        log_message("Thermal: headroom %.1fC on %s, throttle level %d -> %d",
+                    headroom / 1000.0, zones[hottest_zone].type, current_level, level);
+        current_level = level;
+        apply_thermal_level(level);
+    }
+    return current_level;
+}
+
+// Lifts the caps so the tiers are not left throttled after we exit
+void close_thermal(void) {
+    if (!level_applied) return;
+    apply_thermal_level(0);
+    current_level = 0;
+}
+
+int get_thermal_level(void) {
+    return current_level;
+}
+
+int get_thermal_headroom_mc(void) {
+    return last_headroom_mc;
+}
+
+void thermal_report(void) {
+    if (zone_count == 0 || last_headroom_mc < 0) {
+        log_message("Thermal: no thermal zones with trip points");
+        return;
+    }
+    const ThermalLevel *caps = &thermal_levels[current_level];
+    log_message("Thermal: %.1fC on %s, headroom %.1fC, level %d (background cpu %d%%, cached cpu %d%%)",
+                last_temp_mc / 1000.0, zones[hottest_zone].type, last_headroom_mc / 1000.0,
+                current_level, caps->background_pct, caps->cached_pct);
+}
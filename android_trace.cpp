@@ -0,0 +1,441 @@
+#include "android_scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Policy input recorder and offline replay
+ *
+ * Recording (android_scheduler record <trace> ...) appends every monitor
+ * cycle's raw inputs to a compact binary trace: the focused pid, the memory
+ * pressure flag and, per tracked process, the CPU and memory sample, the
+ * audio/GPU/network/visibility flags, the predictor's pre-warm window and the
+ * tier before and after the cycle's decision. Focus changes handled by the
+ * fast path between cycles are recorded too, as TRACE_FOCUS records holding
+ * the processes they promoted or demoted; replay applies them as recorded.
+ *
+ * Replay (android_scheduler replay <trace>) pushes the trace through
+ * calculate_importance_score_at() and decide_app_state() with the
+ * trace's own clock and no side effects. It runs as fast as the CPU allows
+ * and reports tier-transition counts and every disagreement with the recorded
+ * decisions, so weight and threshold changes can be evaluated offline.
+ *
+ * Benchmark (android_scheduler bench [cycles]) writes a synthetic trace with
+ * the same code paths and replays it. It needs no root, cgroups or X display,
+ * so it also serves as the monitor-side PGO training run (see pgo_train.sh).
+ *
+ * Layout (host byte order): TraceFileHeader, then for each cycle a
+ * TraceCycleHeader followed by 'count' TraceSample records.
+ */
+
+#define TRACE_MAGIC "ASTRACE2"
+
+#define TRACE_CYCLE 0            // A monitor cycle's decisions
+#define TRACE_FOCUS 1            // A fast-path focus change between cycles
+
+#define SAMPLE_SAMPLED 0x01      // Per-process sample taken this cycle
+#define SAMPLE_AUDIO 0x02
+#define SAMPLE_GPU 0x04          // GPU activity seen this cycle
+#define SAMPLE_NETWORK 0x08      // Network activity seen this cycle
+#define SAMPLE_SERVICE 0x10      // Classified as a system service
+#define SAMPLE_PSS 0x20          // pss_kb/swap_kb are valid
+#define SAMPLE_VISIBLE 0x40      // On screen without focus
+
+typedef struct {
+    char magic[8];
+    uint32_t sample_size;
+    uint32_t reserved;
+} TraceFileHeader;
+
+typedef struct {
+    int64_t timestamp;
+    int32_t focused_pid;
+    uint16_t count;
+    uint8_t memory_pressure;
+    uint8_t kind;                // TRACE_CYCLE or TRACE_FOCUS
+} TraceCycleHeader;
+
+typedef struct {
+    int32_t pid;
+    int32_t ppid;
+    int32_t app_id;
+    float cpu;
+    int32_t mem_kb;
+    int32_t pss_kb;
+    int32_t swap_kb;
+    int32_t prewarm_secs;        // Left of the pre-warm window, 0 = none
+    uint8_t flags;
+    int8_t requested_priority;
+    uint8_t prev_state;
+    uint8_t state;
+} TraceSample;
+
+static FILE *trace_file = NULL;
+static TraceCycleHeader cycle_header;
+static TraceSample cycle_samples[MAX_PROCESSES];
+
+int trace_open(const char *path) {
+    trace_file = fopen(path, "wb");
+    if (!trace_file) {
+        log_message("Failed to open trace %s: %s", path, strerror(errno));
+        return -1;
+    }
+    TraceFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.sample_size = sizeof(TraceSample);
+    fwrite(&header, sizeof(header), 1, trace_file);
+    log_message("Recording policy inputs to %s", path);
+    return 0;
+}
+
+void trace_close(void) {
+    if (trace_file) {
+        fclose(trace_file);
+        trace_file = NULL;
+    }
+}
+
+void trace_begin_cycle(time_t now, pid_t focused_pid, bool pressure) {
+    if (!trace_file) return;
+    memset(&cycle_header, 0, sizeof(cycle_header));
+    cycle_header.timestamp = now;
+    cycle_header.focused_pid = focused_pid;
+    cycle_header.memory_pressure = pressure ? 1 : 0;
+}
+
+void trace_begin_focus(time_t now, pid_t focused_pid) {
+    if (!trace_file) return;
+    memset(&cycle_header, 0, sizeof(cycle_header));
+    cycle_header.timestamp = now;
+    cycle_header.focused_pid = focused_pid;
+    cycle_header.kind = TRACE_FOCUS;
+}
+
+void trace_record_process(const TrackedProcess *proc, ProcessState prev_state, bool sampled, time_t now) {
+    if (!trace_file || cycle_header.count >= MAX_PROCESSES) return;
+    const ResourceHistory *history = &proc->resource_history;
+
+    TraceSample *sample = &cycle_samples[cycle_header.count++];
+    memset(sample, 0, sizeof(*sample));
+    sample->pid = proc->pid;
+    sample->ppid = proc->ppid;
+    sample->app_id = proc->app_id;
+    sample->cpu = history->cpu_usage[(history->cpu_index + CPU_HISTORY_SIZE - 1) % CPU_HISTORY_SIZE];
+    sample->mem_kb = history->memory_usage[(history->mem_index + MEM_HISTORY_SIZE - 1) % MEM_HISTORY_SIZE];
+    sample->pss_kb = proc->pss_kb;
+    sample->swap_kb = proc->swap_kb;
+    sample->prewarm_secs = (proc->prewarm_until > now) ? (int32_t)(proc->prewarm_until - now) : 0;
+    sample->requested_priority = proc->requested_priority;
+    sample->prev_state = prev_state;
+    sample->state = proc->state;
+
+    if (sampled) sample->flags |= SAMPLE_SAMPLED;
+    if (proc->is_playing_audio) sample->flags |= SAMPLE_AUDIO;
+    if (history->last_gpu_activity == now) sample->flags |= SAMPLE_GPU;
+    if (history->last_network_activity == now) sample->flags |= SAMPLE_NETWORK;
+    if (proc->is_system_service) sample->flags |= SAMPLE_SERVICE;
+    if (proc->pss_sampled_at) sample->flags |= SAMPLE_PSS;
+    if (proc->is_visible) sample->flags |= SAMPLE_VISIBLE;
+}
+
+void trace_end_cycle(void) {
+    if (!trace_file) return;
+    fwrite(&cycle_header, sizeof(cycle_header), 1, trace_file);
+    fwrite(cycle_samples, sizeof(TraceSample), cycle_header.count, trace_file);
+    fflush(trace_file);
+}
+
+static TrackedProcess *replay_find(TrackedProcess *table, int *count, time_t *seen, pid_t pid,
+                                   const TraceSample *sample, time_t now) {
+    for (int i = 0; i < *count; i++) {
+        if (table[i].pid == pid) return &table[i];
+    }
+
+    // New pid: reuse the slot unseen for longest once the table is full
+    int slot = *count;
+    if (*count < REPLAY_MAX_PROCESSES) {
+        (*count)++;
+    } else {
+        slot = 0;
+        for (int i = 1; i < *count; i++) {
+            if (seen[i] < seen[slot]) slot = i;
+        }
+    }
+    TrackedProcess *proc = &table[slot];
+    memset(proc, 0, sizeof(*proc));
+    proc->pid = pid;
+    proc->last_active = now;
+    proc->last_foreground_time = now;
+    proc->state = (ProcessState)sample->prev_state;
+    return proc;
+}
+
+int replay_trace(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        log_message("Failed to open trace %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    TraceFileHeader header;
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.sample_size != sizeof(TraceSample)) {
+        log_message("%s is not a compatible policy trace", path);
+        fclose(f);
+        return -1;
+    }
+
+    static TrackedProcess table[REPLAY_MAX_PROCESSES];
+    static time_t seen[REPLAY_MAX_PROCESSES];
+    int table_count = 0;
+    unsigned long transitions[PROCESS_STATE_COUNT][PROCESS_STATE_COUNT];
+    unsigned long recorded_transitions[PROCESS_STATE_COUNT][PROCESS_STATE_COUNT];
+    memset(transitions, 0, sizeof(transitions));
+    memset(recorded_transitions, 0, sizeof(recorded_transitions));
+    unsigned long cycles = 0, decisions = 0, mismatches = 0, focus_changes = 0;
+
+    bool saved_pressure = memory_pressure;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    TraceCycleHeader cycle;
+    while (fread(&cycle, sizeof(cycle), 1, f) == 1) {
+        if (cycle.count > MAX_PROCESSES ||
+            fread(cycle_samples, sizeof(TraceSample), cycle.count, f) != cycle.count) {
+            log_message("Trace truncated after %lu cycles", cycles);
+            break;
+        }
+        time_t now = (time_t)cycle.timestamp;
+
+        // The fast path's decisions are not rescored, only carried forward
+        if (cycle.kind == TRACE_FOCUS) {
+            focus_changes++;
+            for (int i = 0; i < cycle.count; i++) {
+                const TraceSample *sample = &cycle_samples[i];
+                if (sample->prev_state >= PROCESS_STATE_COUNT || sample->state >= PROCESS_STATE_COUNT) continue;
+                TrackedProcess *proc = replay_find(table, &table_count, seen, sample->pid, sample, now);
+                seen[proc - table] = now;
+                if (sample->state == PROCESS_STATE_FOREGROUND) {
+                    proc->last_foreground_time = now;
+                    proc->last_active = now;
+                }
+                proc->state = (ProcessState)sample->state;
+            }
+            continue;
+        }
+        cycles++;
+        memory_pressure = cycle.memory_pressure;
+
+        TrackedProcess *cycle_procs[MAX_PROCESSES];
+        for (int i = 0; i < cycle.count; i++) {
+            const TraceSample *sample = &cycle_samples[i];
+            cycle_procs[i] = NULL;
+            if (sample->prev_state >= PROCESS_STATE_COUNT || sample->state >= PROCESS_STATE_COUNT) continue;
+
+            TrackedProcess *proc = replay_find(table, &table_count, seen, sample->pid, sample, now);
+            seen[proc - table] = now;
+            cycle_procs[i] = proc;
+            ResourceHistory *history = &proc->resource_history;
+
+            // Replay exactly what update_resource_history() saw
+            if (sample->flags & SAMPLE_SAMPLED) {
+                history->cpu_usage[history->cpu_index] = sample->cpu;
+                history->cpu_index = (history->cpu_index + 1) % CPU_HISTORY_SIZE;
+                history->memory_usage[history->mem_index] = sample->mem_kb;
+                history->mem_index = (history->mem_index + 1) % MEM_HISTORY_SIZE;
+                if (sample->flags & SAMPLE_NETWORK) history->last_network_activity = now;
+                if (sample->flags & SAMPLE_GPU) history->last_gpu_activity = now;
+                proc->is_playing_audio = (sample->flags & SAMPLE_AUDIO) != 0;
+                if (proc->is_playing_audio) proc->last_active = now;
+            }
+            proc->ppid = sample->ppid;
+            proc->app_id = sample->app_id;
+            proc->is_system_service = (sample->flags & SAMPLE_SERVICE) != 0;
+            proc->is_visible = (sample->flags & SAMPLE_VISIBLE) != 0;
+            proc->requested_priority = sample->requested_priority;
+            proc->prewarm_until = sample->prewarm_secs > 0 ? now + sample->prewarm_secs : 0;
+
+            // Keep the memory footprint cached so scoring never touches /proc
+            proc->pss_kb = (sample->flags & SAMPLE_PSS) ? sample->pss_kb : calculate_average_memory(proc);
+            proc->swap_kb = (sample->flags & SAMPLE_PSS) ? sample->swap_kb : 0;
+            proc->pss_sampled_at = now;
+
+            proc->importance_score = calculate_importance_score_at(proc, cycle.focused_pid, now);
+        }
+
+        // Decide per app as the monitor does, then compare each member
+        bool done[MAX_PROCESSES];
+        memset(done, 0, sizeof(done));
+        for (int i = 0; i < cycle.count; i++) {
+            if (!cycle_procs[i] || done[i]) continue;
+
+            TrackedProcess *members[MAX_PROCESSES];
+            int member_index[MAX_PROCESSES];
+            int count = 0;
+            for (int j = i; j < cycle.count; j++) {
+                if (!cycle_procs[j] || done[j] || cycle_samples[j].app_id != cycle_samples[i].app_id) continue;
+                done[j] = true;
+                // The leader goes first, as in get_app_members()
+                int slot = count++;
+                if (cycle_samples[j].pid == cycle_samples[j].app_id && slot > 0) {
+                    members[slot] = members[0];
+                    member_index[slot] = member_index[0];
+                    slot = 0;
+                }
+                members[slot] = cycle_procs[j];
+                member_index[slot] = j;
+            }
+
+            float app_score;
+            ProcessState decided = decide_app_state(members, count, now, &app_score);
+            for (int m = 0; m < count; m++) {
+                const TraceSample *sample = &cycle_samples[member_index[m]];
+                TrackedProcess *proc = members[m];
+                transitions[proc->state][decided]++;
+                recorded_transitions[sample->prev_state][sample->state]++;
+                decisions++;
+
+                if (decided != sample->state) {
+                    if (mismatches < REPLAY_MAX_REPORTED_DIFFS) {
+                        log_message("Replay diff: cycle %lu PID %d recorded %s, replayed %s (app score %.1f)",
+                                    cycles, sample->pid, get_state_name((ProcessState)sample->state),
+                                    get_state_name(decided), app_score);
+                    }
+                    mismatches++;
+                }
+
+                // Follow the recording so later cycles start from the same place
+                proc->state = (ProcessState)sample->state;
+            }
+        }
+    }
+    fclose(f);
+    memory_pressure = saved_pressure;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    log_message("Replayed %lu cycles, %lu decisions, %lu fast-path focus changes in %.3f s (%.0f cycles/s)",
+                cycles, decisions, focus_changes, elapsed, elapsed > 0 ? cycles / elapsed : 0.0);
+    log_message("Decisions matching the recording: %lu of %lu (%lu differ)",
+                decisions - mismatches, decisions, mismatches);
+    log_message("Tier transitions (replayed / recorded):");
+    for (int from = 0; from < PROCESS_STATE_COUNT; from++) {
+        for (int to = 0; to < PROCESS_STATE_COUNT; to++) {
+            if (from == to || (transitions[from][to] == 0 && recorded_transitions[from][to] == 0)) continue;
+            log_message("  %-10s -> %-10s %8lu / %lu", get_state_name((ProcessState)from),
+                        get_state_name((ProcessState)to), transitions[from][to], recorded_transitions[from][to]);
+        }
+    }
+    return 0;
+}
+
+// Small deterministic generator so benchmark runs are comparable
+static unsigned int bench_rand(unsigned int *seed) {
+    *seed = *seed * 1103515245u + 12345u;
+    return (*seed >> 16) & 0x7fff;
+}
+
+int write_synthetic_trace(const char *path, int cycles) {
+    if (trace_open(path) != 0) return -1;
+
+    // A handful of apps take turns in focus; the rest are services, helpers and idle apps
+    static TrackedProcess table[BENCH_PROCESSES];
+    unsigned int seed = 1;
+    // Replay starts each pid at its first cycle's clock; start there too so they agree
+    time_t now = 1000000 + MONITOR_INTERVAL;
+    for (int i = 0; i < BENCH_PROCESSES; i++) {
+        TrackedProcess *proc = &table[i];
+        memset(proc, 0, sizeof(*proc));
+        proc->pid = 1000 + i;
+        proc->ppid = (i >= BENCH_APPS && i % 4 == 0) ? 1000 + i % BENCH_APPS : 1;
+        proc->app_id = (proc->ppid > 1) ? proc->ppid : proc->pid;
+        proc->pidfd = -1;
+        proc->state = (i < BENCH_APPS) ? PROCESS_STATE_VISIBLE : PROCESS_STATE_BACKGROUND;
+        proc->is_system_service = (i % 10 == 9);
+        proc->last_active = now;
+        proc->last_foreground_time = now;
+    }
+
+    pid_t focused_pid = table[0].pid;
+    for (int cycle = 0; cycle < cycles; cycle++) {
+        if (cycle > 0) now += MONITOR_INTERVAL;
+        if (bench_rand(&seed) % 10 == 0) {
+            focused_pid = table[bench_rand(&seed) % BENCH_APPS].pid;
+        }
+        bool pressure = (cycle % 50) >= 45;
+
+        // A predicted next app is held out of the cached tier now and then
+        if (cycle % 100 == 0) table[BENCH_APPS + 2].prewarm_until = now + PREDICTOR_HOLD_SECS;
+        memory_pressure = pressure;
+        trace_begin_cycle(now, focused_pid, pressure);
+
+        ProcessState prev_states[BENCH_PROCESSES];
+        for (int i = 0; i < BENCH_PROCESSES; i++) {
+            TrackedProcess *proc = &table[i];
+            ResourceHistory *history = &proc->resource_history;
+            prev_states[i] = proc->state;
+
+            bool busy = (proc->pid == focused_pid) || bench_rand(&seed) % 20 == 0;
+            history->cpu_usage[history->cpu_index] = busy ? 5 + bench_rand(&seed) % 60 : (bench_rand(&seed) % 20) / 10.0f;
+            history->cpu_index = (history->cpu_index + 1) % CPU_HISTORY_SIZE;
+            history->memory_usage[history->mem_index] = 20000 + (i * 7919) % 400000 + bench_rand(&seed) % 2000;
+            history->mem_index = (history->mem_index + 1) % MEM_HISTORY_SIZE;
+            if (busy && bench_rand(&seed) % 3 == 0) history->last_network_activity = now;
+            if (proc->pid == focused_pid) history->last_gpu_activity = now;
+            proc->is_playing_audio = (i == BENCH_APPS + 1);
+            proc->is_visible = (i == 1 && proc->pid != focused_pid);  // Second monitor
+            if (proc->is_playing_audio) proc->last_active = now;
+
+            proc->pss_kb = calculate_average_memory(proc) * 3 / 4;
+            proc->swap_kb = (proc->state >= PROCESS_STATE_BACKGROUND) ? proc->pss_kb / 8 : 0;
+            proc->pss_sampled_at = now;
+
+            proc->importance_score = calculate_importance_score_at(proc, focused_pid, now);
+        }
+
+        // Helpers share their app's tier, as in the monitor
+        for (int i = 0; i < BENCH_PROCESSES; i++) {
+            if (table[i].app_id != table[i].pid) continue;
+            TrackedProcess *members[BENCH_PROCESSES];
+            int count = 0;
+            members[count++] = &table[i];
+            for (int j = 0; j < BENCH_PROCESSES; j++) {
+                if (j != i && table[j].app_id == table[i].pid) members[count++] = &table[j];
+            }
+            float app_score;
+            ProcessState state = decide_app_state(members, count, now, &app_score);
+            for (int m = 0; m < count; m++) members[m]->state = state;
+        }
+
+        for (int i = 0; i < BENCH_PROCESSES; i++) {
+            trace_record_process(&table[i], prev_states[i], true, now);
+        }
+        trace_end_cycle();
+    }
+    memory_pressure = false;
+    trace_close();
+    return 0;
+}
+
+int run_policy_benchmark(int cycles) {
+    char path[] = "/tmp/android_sched_bench.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        log_message("Failed to create benchmark trace: %s", strerror(errno));
+        return -1;
+    }
+    close(fd);
+
+    log_message("Benchmark: %d cycles of %d synthetic processes", cycles, BENCH_PROCESSES);
+    int result = write_synthetic_trace(path, cycles);
+    if (result == 0) result = replay_trace(path);
+    unlink(path);
+    return result;
+}
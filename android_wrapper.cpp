@@ -15,7 +15,11 @@ int run_android_process_scheduler(int argc, char *argv[]) {
     std::cout << std::endl;
     
     std::cout << "USAGE:" << std::endl;
-    std::cout << "  ./android_scheduler [foreground|background] program [args...]" << std::endl;
+    std::cout << "  ./android_scheduler [foreground|visible|service|background|cached] program [args...]" << std::endl;
+    std::cout << "  ./android_scheduler manifest <file>  (launch every app listed in a manifest)" << std::endl;
+    std::cout << "  ./android_scheduler record <trace> [...]  (any mode, recording policy inputs)" << std::endl;
+    std::cout << "  ./android_scheduler replay <trace>   (re-run a recorded trace offline)" << std::endl;
+    std::cout << "  ./android_scheduler bench [cycles]   (benchmark the policy on a synthetic trace)" << std::endl;
     std::cout << "  ./android_scheduler (with no arguments to monitor existing processes)" << std::endl;
     std::cout << std::endl;
     std::cout << "Examples:" << std::endl;
@@ -29,12 +33,15 @@ int run_android_process_scheduler(int argc, char *argv[]) {
     std::cout << "1. Attach to existing processes (monitor mode)" << std::endl;
     std::cout << "2. Launch a foreground process" << std::endl;
     std::cout << "3. Launch a background process" << std::endl;
-    std::cout << "4. Return to main menu" << std::endl;
-    std::cout << "Enter choice (1-4): ";
+    std::cout << "4. Launch apps from a manifest" << std::endl;
+    std::cout << "5. Replay a recorded policy trace" << std::endl;
+    std::cout << "6. Benchmark the policy on a synthetic trace" << std::endl;
+    std::cout << "7. Return to main menu" << std::endl;
+    std::cout << "Enter choice (1-7): ";
     
     std::getline(std::cin, input);
     
-    if (input == "4") {
+    if (input == "7") {
         std::cout << "Returning to main menu..." << std::endl;
         return 0;
     }
@@ -62,6 +69,25 @@ int run_android_process_scheduler(int argc, char *argv[]) {
             args.push_back(strdup(arg.c_str()));
         }
     }
+    else if (input == "4") {
+        args.push_back(strdup("manifest"));
+        
+        std::cout << "Enter manifest path: ";
+        std::string path;
+        std::getline(std::cin, path);
+        args.push_back(strdup(path.c_str()));
+    }
+    else if (input == "5") {
+        args.push_back(strdup("replay"));
+        
+        std::cout << "Enter trace path: ";
+        std::string path;
+        std::getline(std::cin, path);
+        args.push_back(strdup(path.c_str()));
+    }
+    else if (input == "6") {
+        args.push_back(strdup("bench"));
+    }
     // For option 1, no additional arguments needed
     
     // Null-terminate the args array
@@ -0,0 +1,104 @@
+#!/bin/bash
+
+# Representative workload for profile-guided optimisation and release benchmarks.
+#
+#   ./pgo_train.sh <binary>            run the workload once (PGO training)
+#   ./pgo_train.sh --report <binary>   time the workload and print the results
+#
+# The workload covers both halves of the program:
+#   - a scripted Linux Scheduler Simulator session (mixed classes, policies and
+#     nice values, run to completion on both schedulers)
+#   - the Android monitor's policy benchmark, which replays a synthetic trace
+#     through the scoring and tier decision code
+# Neither part needs root, cgroups or an X display.
+
+REPORT=0
+if [ "$1" == "--report" ]; then
+    REPORT=1
+    shift
+fi
+
+BINARY=$(readlink -f "$1")
+if [ ! -x "$BINARY" ]; then
+    echo "Usage: $0 [--report] <binary>" >&2
+    exit 1
+fi
+
+ROUNDS=${PGO_ROUNDS:-3}
+
+# The simulator saves completed tasks under ./tasks, so run in a scratch directory
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+cd "$WORK_DIR" || exit 1
+
+# Menu input for one simulator session
+simulator_session() {
+    local classes_linux="fg bg daemon empty"
+    local classes_android="fg vis svc bg cache"
+    local policies="ts ts rr fifo idle"
+
+    echo "2"
+    for round in $(seq 10); do
+        local i=0
+        for cls in $classes_linux; do
+            for policy in $policies; do
+                i=$((i + 1))
+                echo "create l${round}_$i $((200 + (i * 37) % 1800)) $(((i * 7) % 40 - 20)) linux $cls $policy"
+            done
+        done
+        echo "use linux"
+        echo "step 50"
+        echo "run_linux"
+        echo "stats"
+
+        i=0
+        for cls in $classes_android; do
+            for policy in $policies; do
+                i=$((i + 1))
+                echo "create a${round}_$i $((200 + (i * 53) % 2000)) $(((i * 11) % 40 - 20)) android $cls $policy"
+            done
+        done
+        echo "use android"
+        echo "step 50"
+        echo "status"
+        echo "run_android"
+        echo "stats"
+    done
+    echo "exit"
+    echo "0"
+}
+
+# Menu input for the Android policy benchmark
+policy_benchmark() {
+    printf '1\n6\n0\n'
+}
+
+now_ms() {
+    echo $(($(date +%s%N) / 1000000))
+}
+
+if [ $REPORT -eq 0 ]; then
+    simulator_session | "$BINARY" > /dev/null 2>&1
+    policy_benchmark | "$BINARY" > /dev/null 2>&1
+    exit 0
+fi
+
+# Best of $ROUNDS for each part
+best_sim=
+best_rate=
+for round in $(seq "$ROUNDS"); do
+    start=$(now_ms)
+    simulator_session | "$BINARY" > /dev/null 2>&1
+    elapsed=$(($(now_ms) - start))
+    if [ -z "$best_sim" ] || [ "$elapsed" -lt "$best_sim" ]; then
+        best_sim=$elapsed
+    fi
+
+    rate=$(policy_benchmark | "$BINARY" 2>&1 | sed -n 's/.*(\([0-9]*\) cycles\/s).*/\1/p')
+    if [ -n "$rate" ] && { [ -z "$best_rate" ] || [ "$rate" -gt "$best_rate" ]; }; then
+        best_rate=$rate
+    fi
+done
+
+echo "Simulator session:  ${best_sim} ms (best of $ROUNDS)"
+echo "Policy benchmark:   ${best_rate:-n/a} monitor cycles/s (best of $ROUNDS)"
@@ -0,0 +1,123 @@
+#!/bin/bash
+
+# GPU sampling against a fabricated proc tree
+#
+# Builds <root>/<pid>/fd and <root>/<pid>/fdinfo by hand and checks the DRM
+# fd scan, the per-client busy sum and the utilisation sampler. The checks are
+# a small program linked against the monitor's objects (everything but the
+# menu), so the tree has to build first.
+
+cd "$(dirname "$0")" || exit 1
+make -s os_scheduler_menu || exit 1
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+ROOT=$WORK_DIR/proc
+
+# pid 100: fd 3 and its dup 4 share client 7, fd 6 is a second client, fd 5 is not DRM
+mkdir -p $ROOT/100/fd $ROOT/100/fdinfo
+ln -s /dev/dri/renderD128 $ROOT/100/fd/3
+ln -s /dev/dri/renderD128 $ROOT/100/fd/4
+ln -s /dev/null $ROOT/100/fd/5
+ln -s /dev/nvidia0 $ROOT/100/fd/6
+cat > $ROOT/100/fdinfo/3 << EOF
+pos:	0
+drm-driver:	i915
+drm-client-id:	7
+drm-engine-render:	1000 ns
+drm-engine-video:	500 ns
+drm-engine-capacity-video:	2
+EOF
+cp $ROOT/100/fdinfo/3 $ROOT/100/fdinfo/4
+cat > $ROOT/100/fdinfo/6 << EOF
+drm-driver:	nvidia
+drm-client-id:	9
+drm-engine-gr:	250 ns
+EOF
+
+# pid 200: a DRM fd whose driver exposes no counters
+mkdir -p $ROOT/200/fd $ROOT/200/fdinfo
+ln -s /dev/dri/card0 $ROOT/200/fd/3
+printf 'drm-driver:\tvirtio_gpu\n' > $ROOT/200/fdinfo/3
+
+cat > $WORK_DIR/test_gpu.cpp << 'EOF'
+#include "android_scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+    if (!ok) failures++;
+}
+
+static void write_busy(const char *root, int fd, int client, unsigned long long ns) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/100/fdinfo/%d", root, fd);
+    FILE *f = fopen(path, "w");
+    fprintf(f, "drm-client-id:\t%d\ndrm-engine-render:\t%llu ns\n", client, ns);
+    fclose(f);
+}
+
+int main(int argc, char *argv[]) {
+    (void)argc;
+    const char *root = argv[1];
+    int fds[MAX_DRM_FDS];
+    unsigned long long busy;
+
+    int count = scan_drm_fds(root, 100, fds, MAX_DRM_FDS);
+    bool found[8] = { false };
+    for (int i = 0; i < count; i++) if (fds[i] >= 0 && fds[i] < 8) found[fds[i]] = true;
+    check(count == 3 && found[3] && found[4] && found[6], "scan finds /dev/dri and /dev/nvidia fds only");
+    check(scan_drm_fds(root, 300, fds, MAX_DRM_FDS) == 0, "scan of a missing pid finds nothing");
+    check(scan_drm_fds(root, 100, fds, 2) == 2, "scan stops at max");
+
+    count = scan_drm_fds(root, 100, fds, MAX_DRM_FDS);
+    check(read_drm_busy_ns(root, 100, fds, count, &busy) == 0 && busy == 1750,
+          "busy time sums engines, skips capacity and counts a dup'd client once");
+    count = scan_drm_fds(root, 200, fds, MAX_DRM_FDS);
+    check(read_drm_busy_ns(root, 200, fds, count, &busy) == -1, "no counters reports -1");
+
+    // Sampler: a baseline, then an fd set change must not show the new fd's lifetime
+    set_gpu_proc_root(root);
+    TrackedProcess proc;
+    memset(&proc, 0, sizeof(proc));
+    proc.pid = 100;
+    time_t now = 1000;
+    sample_gpu_utilization(&proc, now);
+    usleep(20000);
+    check(sample_gpu_utilization(&proc, now) == 0, "idle client samples 0%");
+
+    char path[512], target[] = "/dev/dri/renderD129";
+    snprintf(path, sizeof(path), "%s/100/fd/7", root);
+    if (symlink(target, path) != 0) return 1;
+    write_busy(root, 7, 11, 3600000000000ULL);
+    usleep(20000);
+    now += GPU_FD_REFRESH_SECS;
+    check(sample_gpu_utilization(&proc, now) == 0 && proc.drm_fd_count == 4,
+          "new fd resets the baseline instead of spiking");
+
+    // 3 clients each busy for 100ms over ~20ms of wall time
+    write_busy(root, 3, 7, 100000000ULL + 1000);
+    write_busy(root, 4, 7, 100000000ULL + 1000);
+    write_busy(root, 6, 9, 100000000ULL + 250);
+    write_busy(root, 7, 11, 3600000000000ULL + 100000000ULL);
+    usleep(20000);
+    float percent = sample_gpu_utilization(&proc, now);
+    check(percent == 100, "summed engines are clamped to 100%");
+
+    printf("%d failures\n", failures);
+    return failures ? 1 : 0;
+}
+EOF
+
+OBJS=$(ls *.o | grep -v '^menu\.o$')
+g++ -std=c++11 -pthread -I. $WORK_DIR/test_gpu.cpp $OBJS -ldl -o $WORK_DIR/test_gpu || exit 1
+
+echo "================================"
+echo "Testing GPU sampling"
+echo "================================"
+$WORK_DIR/test_gpu $ROOT
@@ -0,0 +1,152 @@
+#!/bin/bash
+
+# Thermal throttling against a fabricated thermal_zone tree
+#
+# Builds <root>/thermal_zone*/{type,temp,trip_point_N_*} by hand and checks the
+# trip-point choice, the throttle levels with their hysteresis, the cpuset
+# prefix for each level and that the first scan clears stale caps. The checks
+# are a small program linked against the monitor's objects (everything but the
+# menu), so the tree has to build first. No cgroup is written: the tiers are
+# not set up, so the caps are computed but not applied.
+
+cd "$(dirname "$0")" || exit 1
+make -s os_scheduler_menu || exit 1
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+ROOT=$WORK_DIR/thermal
+mkdir -p $WORK_DIR/empty
+
+zone() {
+    local dir=$ROOT/thermal_zone$1
+    mkdir -p $dir
+    echo $2 > $dir/type
+    echo $3 > $dir/temp
+    shift 3
+    local trip=0
+    while [ $# -gt 0 ]; do
+        echo $1 > $dir/trip_point_${trip}_type
+        echo $2 > $dir/trip_point_${trip}_temp
+        trip=$((trip + 1))
+        shift 2
+    done
+}
+
+# The lowest passive trip wins over hot/critical ones
+zone 0 x86_pkg_temp 50000 critical 100000 passive 95000 passive 90000
+# No passive trip: the lowest of hot and critical
+zone 1 acpitz 20000 critical 80000 hot 70000
+# Only an active (fan) trip: not a throttling zone
+zone 2 fan 30000 active 40000
+# A disabled trip (0) is skipped
+zone 3 battery 10000 passive 0 hot 60000
+
+cat > $WORK_DIR/test_thermal.cpp << 'EOF'
+#include "android_scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failures = 0;
+static const char *root;
+
+static void check(bool ok, const char *what) {
+    printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+    if (!ok) failures++;
+}
+
+static void set_temp(int zone, int temp) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/thermal_zone%d/temp", root, zone);
+    FILE *f = fopen(path, "w");
+    fprintf(f, "%d\n", temp);
+    fclose(f);
+}
+
+// Zone 0 throttles at 90C
+static int level_at_headroom(int headroom_mc) {
+    set_temp(0, 90000 - headroom_mc);
+    return update_thermal_state();
+}
+
+static bool cpuset_is(int level, const char *effective, const char *expected) {
+    int cpus[64];
+    char buf[256];
+    int count = parse_cpu_list(effective, cpus, 64);
+    thermal_cpuset(level, cpus, count, buf, sizeof(buf));
+    if (strcmp(buf, expected) == 0) return true;
+    printf("  level %d of '%s' gave '%s', expected '%s'\n", level, effective, buf, expected);
+    return false;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) return 1;
+    root = argv[1];
+    set_thermal_root(root);
+
+    // Only the first update, for the log check in the script
+    if (strcmp(argv[2], "first") == 0) {
+        update_thermal_state();
+        return 0;
+    }
+
+    check(update_thermal_state() == 0 && get_thermal_headroom_mc() == 40000,
+          "passive trip preferred, headroom from the closest zone");
+    set_temp(1, 60000);
+    check(update_thermal_state() == 1 && get_thermal_headroom_mc() == 10000,
+          "hot trip used when a zone has no passive one");
+    set_temp(1, 20000);
+
+    check(level_at_headroom(20000) == 0, "20C headroom: level 0");
+    check(level_at_headroom(14000) == 1, "14C: level 1");
+    check(level_at_headroom(9000) == 2, "9C: level 2");
+    check(level_at_headroom(10500) == 2, "10.5C: stays at 2 inside the hysteresis");
+    check(level_at_headroom(12500) == 1, "12.5C: relaxes to 1");
+    check(level_at_headroom(4000) == 3, "4C: jumps straight to 3");
+    check(level_at_headroom(6500) == 3, "6.5C: stays at 3 inside the hysteresis");
+    check(level_at_headroom(7500) == 2, "7.5C: relaxes to 2");
+    check(level_at_headroom(-3000) == 3 && get_thermal_headroom_mc() == 0, "past the trip: headroom 0, level 3");
+    check(level_at_headroom(20000) == 0, "20C: back to level 0 in one step");
+
+    level_at_headroom(4000);
+    close_thermal();
+    check(get_thermal_level() == 0, "close_thermal lifts the caps");
+
+    check(cpuset_is(0, "0-7", "") && cpuset_is(1, "0-7", ""), "levels 0 and 1 keep every CPU");
+    check(cpuset_is(2, "0-7", "0-3"), "level 2 halves the CPUs");
+    check(cpuset_is(3, "0-7", "0"), "level 3 keeps one CPU");
+    check(cpuset_is(2, "8-15", "8-11") && cpuset_is(3, "8-15", "8"), "prefix of a list not starting at 0");
+    check(cpuset_is(2, "0-1,4-7,10", "0-1,4"), "prefix of a non-contiguous list");
+    check(cpuset_is(2, "3", "3"), "one CPU stays one CPU");
+    check(cpuset_is(2, "", ""), "unknown CPUs leave the cpuset alone");
+
+    printf("%d failures\n", failures);
+    return failures ? 1 : 0;
+}
+EOF
+
+OBJS=$(ls *.o | grep -v '^menu\.o$')
+g++ -std=c++11 -pthread -I. $WORK_DIR/test_thermal.cpp $OBJS -ldl -o $WORK_DIR/test_thermal || exit 1
+
+echo "================================"
+echo "Testing thermal throttling"
+echo "================================"
+FAILED=0
+
+# The first scan applies level 0 to clear caps left by a previous instance
+OUTPUT=$($WORK_DIR/test_thermal $ROOT first)
+if echo "$OUTPUT" | grep -q "monitoring 3 zones" && echo "$OUTPUT" | grep -q "throttle level 0 -> 0"; then
+    echo "PASS: first scan finds 3 zones and applies level 0"
+else
+    echo "FAIL: first scan finds 3 zones and applies level 0"
+    FAILED=1
+fi
+if $WORK_DIR/test_thermal $WORK_DIR/empty first | grep -q "clearing throttle caps"; then
+    echo "PASS: no zones still clears caps"
+else
+    echo "FAIL: no zones still clears caps"
+    FAILED=1
+fi
+
+$WORK_DIR/test_thermal $ROOT levels | grep -v '^\[' || FAILED=1
+exit $FAILED